@@ -0,0 +1,369 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "assembler.h"
+#include "context.h"
+#include "corpus.h"
+#include "image.h"
+#include "linker.h"
+#include "parser.h"
+#include "thumb.h"
+#include "tokenizer.h"
+
+using namespace a2;
+
+namespace {
+
+std::atomic<std::size_t> gAllocCount{0};
+std::atomic<std::size_t> gAllocBytes{0};
+
+}
+
+// every heap allocation of the benchmark goes through here, so a stage can report what it allocates
+void* operator new(std::size_t size) {
+  gAllocCount.fetch_add(1, std::memory_order_relaxed);
+  gAllocBytes.fetch_add(size, std::memory_order_relaxed);
+  if (auto p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+template<typename T, typename F>
+void Run(const char* name, const std::vector<T>& lines, std::size_t rounds, F f, const char* unit = "lines/s") {
+  auto allocs = gAllocCount.load();
+  auto start = std::chrono::steady_clock::now();
+  std::size_t sink = 0;
+  for (std::size_t r = 0; r < rounds; r++) {
+    for (auto& line : lines) {
+      sink += f(line);
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  allocs = gAllocCount.load() - allocs;
+
+  auto total = static_cast<double>(lines.size() * rounds);
+  std::cout << "  " << std::left << std::setw(24) << name
+            << std::right << std::setw(12) << std::fixed << std::setprecision(0) << total / elapsed.count()
+            << " " << unit << std::setprecision(2) << "  " << allocs / total << " allocs each  (" << sink << ")"
+            << std::endl;
+}
+
+void BenchTokenizer(std::size_t rounds) {
+  std::vector<SourceLine> constants = {
+    {"  ahb1:             0x40021000", 2},
+    {"    rcc:            0x00", 4},
+    {"      apb2rstr:     0x0a", 6},
+    {"        .iopaen:    0x01", 8},
+    {"        .*:         0x11", 8},
+    {"  flash_sz:         16384", 2},
+  };
+  std::vector<SourceLine> refs = {
+    {"  stack_addr: flash_addr + flash_sz", 2},
+    {"  reset_addr: @reset + 0x01", 2},
+    {"  int_handler: ahb1.rcc.cr - ahb1.rcc.cfgr + @int + 4", 2},
+  };
+  std::vector<SourceLine> insts = {
+    {"    NOP", 4},
+    {"    B(loop)", 4},
+    {"    STR(ahb1.rcc.cr, @int + 0x1)", 4},
+    {"    JUMP(io.a, 0x18, @reset, flash_addr + flash_sz - 4)", 4},
+  };
+  std::vector<SourceLine> tags = { {"  loop:", 2}, {"    NOP", 4} };
+
+  std::cout << std::endl << "== tokenizer ==" << std::endl;
+  Run("TokenizeNamedConstant", constants, rounds, [](auto& s) { return TokenizeNamedConstant(s).value; });
+  Run("TokenizeNamedRef", refs, rounds, [](auto& s) { return TokenizeNamedRef(s).value.size(); });
+  Run("TokenizeInstruction", insts, rounds, [](auto& s) { return TokenizeInstruction(s).args.size(); });
+  Run("TryTokenizeNamedTag", tags, rounds, [](auto& s) { return std::get<0>(TryTokenizeNamedTag(s)) ? 1 : 0; });
+}
+
+void BenchEncoder(std::size_t rounds) {
+  std::stringstream source;
+  source << "_sys:\n  flash_addr: 0x08000000\n  count: 8\n\nmain:\n  loop:\n";
+  for (int i = 0; i < 64; i++) {
+    source << "    MOVS(r0, count)\n"
+           << "    ADDS(r1, r1, r0)\n"
+           << "    LDR(r2, r1, 4)\n"
+           << "    STR(r2, sp, 8)\n"
+           << "    PUSH(r4, r5, lr)\n"
+           << "    CMP(r1, r8)\n"
+           << "    BNE(loop)\n"
+           << "    NOP\n";
+  }
+  auto a2 = ParseA2(source);
+
+  std::cout << std::endl << "== encoder ==" << std::endl;
+  Run("EncodeThumb", a2->instructions, rounds, [](auto& inst) { return EncodeThumb(inst).bits.value; }, "insts/s");
+}
+
+std::unique_ptr<A2> Parse(const std::string& corpus) {
+  std::stringstream in(corpus);
+  return ParseA2(in);
+}
+
+// Line fetching, the first thing every parse does: splitting the text into lines.
+void BenchLines(const std::string& corpus, std::size_t rounds) {
+  std::size_t lines = 0;
+  auto allocs = gAllocCount.load();
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t r = 0; r < rounds; r++) {
+    lines += LineIndex(corpus).Lines().size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  allocs = gAllocCount.load() - allocs;
+
+  std::cout << std::endl << "== corpus, " << corpus.size() / 1024 << " KiB, " << lines / rounds << " lines ==" << std::endl;
+  std::cout << "  " << std::left << std::setw(24) << "LineIndex" << std::right << std::setw(12) << std::fixed
+            << std::setprecision(0) << lines / elapsed.count() << " lines/s  "
+            << corpus.size() * rounds / elapsed.count() / (1 << 20) << " MiB/s, " << allocs / rounds
+            << " allocs per text" << std::endl;
+}
+
+// every Tokenize* function on the lines of the corpus it is meant for
+void BenchCorpusTokenizer(const std::string& corpus, std::size_t rounds) {
+  LineIndex index(corpus);
+  std::vector<SourceLine> constants, refs, insts, tags;
+  auto block = '\0';
+  for (auto& line : index.Lines()) {
+    if (line.indent == 0) {
+      block = line.text[0];
+    } else if (block == '_') {
+      constants.push_back(line);
+    } else if (block == '#') {
+      refs.push_back(line);
+    } else if (line.text.back() == ':') {
+      tags.push_back(line);
+    } else {
+      insts.push_back(line);
+    }
+  }
+
+  std::vector<std::string_view> paths;
+  auto a2 = Parse(corpus);
+  for (std::uint32_t i = 0; i < a2->constants.NodeCount(); i++) {
+    paths.push_back(a2->constants.Node(i).path.Str());
+  }
+
+  Run("TokenizeNamedConstant", constants, rounds, [](auto& s) { return TokenizeNamedConstant(s).value; });
+  Run("TokenizeNamedRef", refs, rounds, [](auto& s) { return TokenizeNamedRef(s).value.size(); });
+  Run("TokenizeInstruction", insts, rounds, [](auto& s) { return TokenizeInstruction(s).args.size(); });
+  Run("TryTokenizeNamedTag", tags, rounds, [](auto& s) { return std::get<0>(TryTokenizeNamedTag(s)) ? 1 : 0; });
+  Run("TokenizeConstRef", paths, rounds, [](auto& s) { return TokenizeConstRef(s).size(); }, "paths/s");
+}
+
+// every constant of the corpus, by interned path and by block and dotted path
+void BenchConstants(const std::string& corpus, std::size_t rounds) {
+  auto a2 = Parse(corpus);
+  auto& table = a2->constants;
+  std::vector<Symbol> paths;
+  std::vector<std::pair<Symbol, std::string_view>> walks;
+  for (std::uint32_t i = 0; i < table.NodeCount(); i++) {
+    auto root = i;
+    while (table.Node(root).parent != ConstantsData::kNone) {
+      root = table.Node(root).parent;
+    }
+    if (root != i) {
+      paths.push_back(table.Node(i).path);
+      walks.emplace_back(table.Node(root).name, table.Node(i).path.Str());
+    }
+  }
+
+  Run("Find(path)", paths, rounds, [&table](auto& path) { return table.Find(path)->value; }, "lookups/s");
+  Run("Find(block, path)", walks, rounds, [&table](auto& walk) {
+    return table.Find(walk.first, walk.second)->value;
+  }, "lookups/s");
+}
+
+// with the listing (-l) written to a string stream as well
+void BenchAssemble(const std::string& corpus, std::size_t rounds, bool listing) {
+  auto a2 = Parse(corpus);
+  std::vector<const A2*> programs(rounds, a2.get());
+  auto allocs = gAllocCount.load();
+  auto start = std::chrono::steady_clock::now();
+  std::size_t bytes = 0;
+  std::size_t listing_bytes = 0;
+  for (auto program : programs) {
+    std::stringstream image;
+    std::stringstream text;
+    Assemble(*program, image, EImageFormat::kBin, listing ? &text : nullptr);
+    bytes += image.str().size();
+    listing_bytes += text.str().size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  allocs = gAllocCount.load() - allocs;
+
+  std::cout << "  " << std::left << std::setw(24) << (listing ? "Assemble + listing" : "Assemble") << std::right << std::setw(12) << std::fixed
+            << std::setprecision(0) << a2->instructions.size() * rounds / elapsed.count() << " insts/s  "
+            << allocs / rounds << " allocs per image of " << bytes / rounds << " bytes";
+  if (listing) {
+    std::cout << ", " << listing_bytes / rounds << " of listing";
+  }
+  std::cout << std::endl;
+}
+
+// Stress: callers on their own threads parse and assemble the corpus through one shared Context,
+// rounds programs in all. Every image must match the single-threaded one.
+void BenchContext(const std::string& corpus, std::size_t rounds) {
+  Context context;
+  auto read = [&corpus] { std::stringstream in(corpus); return SourceBuffer::Read(in); };
+  auto expected = context.Assemble(*context.Parse(read()).get());
+
+  for (std::size_t threads : {1, 2, 4, 8}) {
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> mismatches{0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> callers;
+    for (std::size_t t = 0; t < threads; t++) {
+      callers.emplace_back([&] {
+        while (next++ < rounds) {
+          if (context.Assemble(*context.Parse(read()).get()) != expected) {
+            mismatches++;
+          }
+        }
+      });
+    }
+    for (auto& caller : callers) {
+      caller.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "  " << std::left << std::setw(24) << ("Context x" + std::to_string(threads)) << std::right
+              << std::setw(12) << std::fixed << std::setprecision(1) << rounds / elapsed.count() << " programs/s  "
+              << mismatches << " mismatched images" << std::endl;
+  }
+}
+
+void BenchParse(const std::string& corpus, std::size_t rounds) {
+  std::stringstream text(corpus);
+  auto source = SourceBuffer::Read(text);
+  std::vector<std::unique_ptr<SourceBuffer>> sources;
+  for (std::size_t r = 0; r < rounds; r++) {
+    std::stringstream copy(std::string(source->Text()));
+    sources.push_back(SourceBuffer::Read(copy));
+    sources.back()->Lines();
+  }
+
+  // building and tearing down the tree, reading the text is not counted
+  auto allocs = gAllocCount.load();
+  auto bytes = gAllocBytes.load();
+  std::size_t insts = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (auto& s : sources) {
+    auto a2 = ParseA2(std::move(s));
+    insts += a2->instructions.size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  allocs = gAllocCount.load() - allocs;
+  bytes = gAllocBytes.load() - bytes;
+
+  std::cout << "  " << std::left << std::setw(24) << "ParseA2"
+            << std::right << std::setw(12) << std::fixed << std::setprecision(0) << insts / elapsed.count() << " insts/s  "
+            << allocs / rounds << " allocs, " << bytes / rounds / 1024 << " KiB per parse of "
+            << insts / rounds << " insts" << std::endl;
+}
+
+// Links 1M pieces, a quarter of them with a relocation, the table and branch mix of a program.
+// Adding is not counted.
+void BenchLinker(std::size_t rounds) {
+  constexpr std::uint32_t kPieces = 1 << 20;
+  std::vector<Symbol> tags;
+  for (std::uint32_t i = 0; i < 1024; i++) {
+    tags.push_back(Intern("t" + std::to_string(i)));
+  }
+
+  double link = 0;
+  double bytes = 0;
+  std::size_t sink = 0;
+  for (std::size_t r = 0; r < rounds; r++) {
+    Linker linker;
+    for (std::uint32_t i = 0; i < kPieces; i++) {
+      auto piece = linker.Add({i % 3 == 0 ? 4 : 2, i, true, {}, i % 1024 == 0 ? tags[i / 1024] : Symbol()});
+      if (i % 4 == 0) {
+        linker.Relocate(piece, tags[(i * 7) % 1024], ERefedOp::kNone);
+      }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    linker.Link(0x08000000);
+    auto linked = std::chrono::steady_clock::now();
+    sink += linker.Bytes().size();
+    auto written = std::chrono::steady_clock::now();
+    link += std::chrono::duration<double>(linked - start).count();
+    bytes += std::chrono::duration<double>(written - linked).count();
+  }
+
+  std::cout << std::endl << "== linker ==" << std::endl;
+  std::cout << "  " << std::left << std::setw(24) << "Link" << std::right << std::setw(12) << std::fixed
+            << std::setprecision(0) << kPieces * rounds / link << " pieces/s" << std::endl;
+  std::cout << "  " << std::left << std::setw(24) << "Bytes" << std::right << std::setw(12) << std::fixed
+            << std::setprecision(0) << kPieces * rounds / bytes << " pieces/s  (" << sink << ")" << std::endl;
+}
+
+// formats a 16 MiB image, the size of a large flash part, into a preallocated buffer
+void BenchImage(std::size_t rounds) {
+  Linker linker;
+  for (std::uint32_t i = 0; i < (16u << 20) / 4; i++) {
+    linker.Add({4, i * 2654435761u, true, {}, {}});
+  }
+  linker.Link(0x08000000);
+  auto image = MakeImage(linker);
+
+  std::cout << std::endl << "== image ==" << std::endl;
+  for (auto format : {EImageFormat::kBin, EImageFormat::kHex, EImageFormat::kElf}) {
+    std::stringstream out;
+    WriteImage(image, format, out);      // grows the stream once, not timed
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t r = 0; r < rounds; r++) {
+      out.seekp(0);
+      WriteImage(image, format, out);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "  " << std::left << std::setw(24) << gImageFormatToStr[format]
+              << std::right << std::setw(12) << std::fixed << std::setprecision(0)
+              << image.bytes.size() * rounds / elapsed.count() / (1 << 20) << " MiB/s" << std::endl;
+  }
+}
+
+}
+
+// a2_bench [rounds] [scale]
+// a2_bench -g file [scale] [seed] writes a corpus instead, e.g. to time the a2 executable on it
+int main(int argc, char* argv[]) {
+  if (argc > 2 && argv[1] == std::string("-g")) {
+    auto scale = argc > 3 ? std::stod(argv[3]) : 1.0;
+    auto seed = argc > 4 ? static_cast<std::uint32_t>(std::stoul(argv[4])) : 1u;
+    std::ofstream(argv[2], std::ios::binary) << MakeCorpus(ScaledCorpus(scale, seed));
+    return 0;
+  }
+
+  std::size_t rounds = argc > 1 ? std::stoul(argv[1]) : 100000;
+  auto corpus = MakeCorpus(ScaledCorpus(argc > 2 ? std::stod(argv[2]) : 1.0));
+  auto corpus_rounds = std::max<std::size_t>(rounds / 10000, 1);
+  BenchTokenizer(rounds);
+  BenchEncoder(rounds / 100);
+  BenchLines(corpus, corpus_rounds * 10);
+  BenchCorpusTokenizer(corpus, corpus_rounds);
+  BenchConstants(corpus, corpus_rounds * 10);
+  BenchParse(corpus, corpus_rounds);
+  BenchAssemble(corpus, corpus_rounds, false);
+  BenchAssemble(corpus, corpus_rounds, true);
+  BenchContext(corpus, corpus_rounds * 8);
+  BenchLinker(std::max<std::size_t>(rounds / 10000, 1));
+  BenchImage(std::max<std::size_t>(rounds / 10000, 1));
+}
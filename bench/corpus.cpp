@@ -0,0 +1,173 @@
+#include "corpus.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+// level names below a peripheral, p3.r1.f2.g0
+constexpr char kLevelNames[] = "rfghjk";
+
+std::string Hex(std::size_t n) {
+  static const char digits[] = "0123456789abcdef";
+  std::string s;
+  do {
+    s.insert(s.begin(), digits[n & 0xf]);
+    n >>= 4;
+  } while (n != 0);
+  return "0x" + s;
+}
+
+class Corpus {
+public:
+  explicit Corpus(const CorpusOptions& options) : o_(options), random_(options.seed) {}
+
+  std::string Make() {
+    text_.reserve(o_.code_blocks * o_.block_length * 28 + o_.peripherals * 4096);
+    Sys();
+    Preph();
+    Table();
+    for (std::size_t b = 0; b < o_.code_blocks; b++) {
+      Code(b);
+    }
+    return std::move(text_);
+  }
+
+private:
+  // mt19937 output is fixed by the standard, the distributions are not, so no distributions
+  std::size_t Next(std::size_t n) { return n == 0 ? 0 : random_() % n; }
+
+  void Line(std::size_t indent, const std::string& s) {
+    text_.append(indent * 2, ' ');
+    text_ += s;
+    text_ += '\n';
+  }
+
+  void Sys() {
+    Line(0, "_sys:");
+    Line(1, "flash_addr: 0x08000000");
+    Line(1, "flash_sz: " + Hex(std::max<std::size_t>(o_.code_blocks * o_.block_length * 4, 0x4000)));
+    Line(1, "count: 8");
+  }
+
+  void Preph() {
+    Line(0, "_preph:");
+    for (std::size_t p = 0; p < o_.peripherals; p++) {
+      Line(1, "p" + std::to_string(p) + ": " + Hex(0x40000000 + p * 0x400));
+      Level(2, 1);
+    }
+  }
+
+  // register offsets, small multiples of 4 so any of them is a valid LDR/STR offset
+  void Level(std::size_t indent, std::size_t level) {
+    if (level > o_.depth) {
+      Line(indent, ".en: 0x01");
+      return;
+    }
+    for (std::size_t i = 0; i < o_.fanout; i++) {
+      Line(indent, LevelName(level) + std::to_string(i) + ": " + Hex(Offset(i)));
+      Level(indent + 1, level + 1);
+    }
+  }
+
+  static std::string LevelName(std::size_t level) {
+    return std::string(1, kLevelNames[(level - 1) % (sizeof(kLevelNames) - 1)]);
+  }
+
+  static std::size_t Offset(std::size_t i) { return (i % 30) * 4; }
+
+  // a constant at a random depth, e.g. p12.r3.f0
+  std::string ConstRef() {
+    auto path = "p" + std::to_string(Next(o_.peripherals));
+    auto levels = 1 + Next(o_.depth);
+    for (std::size_t level = 1; level <= levels; level++) {
+      path += "." + LevelName(level) + std::to_string(Next(o_.fanout));
+    }
+    return path;
+  }
+
+  std::string Block(std::size_t b) { return "f" + std::to_string(b); }
+
+  void Table() {
+    Line(0, "#vectors:");
+    Line(1, "stack: flash_addr + flash_sz");
+    for (std::size_t i = 0; i < o_.table_entries; i++) {
+      auto n = std::to_string(i);
+      switch (Next(4)) {
+        case 0:
+          Line(1, "w" + n + ": " + ConstRef() + " + " + ConstRef() + " + 0x10");
+          break;
+        case 1: {
+          auto a = Next(o_.code_blocks);
+          auto b = Next(o_.code_blocks);
+          Line(1, "s" + n + ": @" + Block(std::max(a, b)) + " - @" + Block(std::min(a, b)));
+          break;
+        }
+        default:
+          Line(1, "v" + n + ": @" + Block(Next(o_.code_blocks)) + " + 1");
+          break;
+      }
+    }
+  }
+
+  std::string Reg() { return "r" + std::to_string(Next(8)); }
+  std::string Regs(std::size_t n) {
+    std::string s = Reg();
+    for (std::size_t i = 1; i < n; i++) {
+      s += ", " + Reg();
+    }
+    return s;
+  }
+
+  // Encodable instructions only: branches stay within reach (a local tag at most 16 instructions
+  // back, calls to blocks at most 256 away) and immediates within their fields.
+  void Code(std::size_t b) {
+    Line(0, Block(b) + ":");
+    std::string local;
+    for (std::size_t i = 0; i < o_.block_length; i++) {
+      if (i % 16 == 0) {
+        local = "l" + std::to_string(b) + "_" + std::to_string(i / 16);
+        Line(1, local + ":");
+      }
+      switch (Next(10)) {
+        case 0: Line(2, "MOVS(" + Reg() + ", count)"); break;
+        case 1: Line(2, "MOVS(" + Reg() + ", " + std::to_string(Next(256)) + ")"); break;
+        case 2: Line(2, "ADDS(" + Regs(3) + ")"); break;
+        case 3: Line(2, "LDR(" + Regs(2) + ", " + ConstRef() + ")"); break;
+        case 4: Line(2, "STR(" + Regs(2) + ", " + ConstRef() + " + 4)"); break;
+        case 5: Line(2, "CMP(" + Reg() + ", " + Hex(Next(256)) + ")"); break;
+        case 6: Line(2, "PUSH(r4, r5, r6, lr)"); break;
+        case 7: Line(2, "BNE(" + local + ")"); break;
+        case 8: {
+          auto lo = b > 256 ? b - 256 : 0;
+          auto hi = std::min(b + 256, o_.code_blocks - 1);
+          Line(2, "BL(" + Block(lo + Next(hi - lo + 1)) + ")");
+          break;
+        }
+        default: Line(2, "LSLS(" + Regs(2) + ", " + std::to_string(Next(32)) + ")"); break;
+      }
+    }
+    Line(2, "BX(lr)");
+  }
+
+  const CorpusOptions& o_;
+  std::mt19937 random_;
+  std::string text_;
+};
+
+}
+
+CorpusOptions ScaledCorpus(double scale, std::uint32_t seed) {
+  CorpusOptions options;
+  auto scaled = [scale](std::size_t n) { return std::max<std::size_t>(static_cast<std::size_t>(n * scale), 1); };
+  options.seed = seed;
+  options.peripherals = scaled(options.peripherals);
+  options.table_entries = scaled(options.table_entries);
+  options.code_blocks = scaled(options.code_blocks);
+  return options;
+}
+
+std::string MakeCorpus(const CorpusOptions& options) {
+  return Corpus(options).Make();
+}
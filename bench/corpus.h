@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Shape of a synthetic .a2 program. The same options and seed always give the same text, and the
+// program parses and assembles.
+struct CorpusOptions {
+  std::uint32_t seed = 1;
+  std::size_t peripherals = 64;     // top-level constants of the _preph block
+  std::size_t depth = 3;            // levels of constants below each peripheral
+  std::size_t fanout = 4;           // constants per level, the deepest ones get a bits info line
+  std::size_t table_entries = 1024; // of the #vectors block, addresses and constant arithmetic
+  std::size_t code_blocks = 512;
+  std::size_t block_length = 64;    // instructions per code block, a local tag every 16
+};
+
+// every count multiplied by scale, depth and fanout kept
+CorpusOptions ScaledCorpus(double scale, std::uint32_t seed = 1);
+
+std::string MakeCorpus(const CorpusOptions& options);
@@ -1,91 +1,241 @@
 #include "assembler.h"
 
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <vector>
 
-#include "tokenizer.h"
+#include "exception.h"
+#include "listing.h"
+#include "parser.h"
+#include "stats.h"
+#include "thumb.h"
+#include "util.h"
+#include "testutil.h"
 
-namespace {
+namespace a2 {
 
-using namespace a2;
+// table entries are 32-bit words, their series are folded so only @address terms need linking
+template<typename L>
+void AssembleEntry(const NamedRef& entry, L& linker) {
+  Bits bits{};
+  bits.tag = entry.name;
+  bits.size = 4;
+  bits.resolved = true;
+
+  for (auto& refed : entry.value) {
+    if (refed.type == ERefedType::kNum) {
+      bits.value = static_cast<unsigned int>(refed.num);
+    }
+  }
+
+  auto piece = linker.Add(bits);
+  for (auto& refed : entry.value) {
+    if (refed.type == ERefedType::kAddr) {
+      linker.Relocate(piece, refed.ref, refed.op);
+    }
+  }
+}
 
-a2::Bits MakeThumbInstruction(unsigned int code, const std::string& tag = "") {
-  a2::Bits bits{};
-  bits.tag = 
-  bits.size = 2;
-  bits.value = code;
-  return bits;
+template<typename L>
+std::uint32_t AssembleInstruction(const Instruction& inst, L& linker) {
+  auto encoded = EncodeThumb(inst);
+  encoded.bits.tag = inst.tag;
+  auto piece = linker.Add(encoded.bits);
+  if (!encoded.target.Empty()) {
+    linker.Relocate(piece, encoded.target, ERefedOp::kNone, encoded.kind, encoded.addend);
+  }
+  return piece;
 }
 
-std::size_t FetchConstantValue(const std::string& s, const A2& a2) {
-  const ConstantsData* constants = nullptr;
-  for (auto& token : TokenizeConstRef(s)) {
-    if (constants == nullptr) {
-      for (auto& pair : a2.constants) {
-        auto itr = pair.second->children.find(token);
-        if (itr != pair.second->children.end()) {
-          constants = itr->second.get();
-          break;
-        }
-      }
-    } else {
-      auto itr = constants->children.find(token);
-      if (itr != constants->children.end()) {
-        constants = itr->second.get();
-      }
+void AssembleTable(const A2& a2, Linker& linker) {
+  for (const auto& entry : a2.table) {
+    AssembleEntry(entry, linker);
+  }
+}
+
+void AssembleCode(const A2& a2, Linker& linker) {
+  auto block = a2.code_blocks.begin();
+  for (std::size_t i = 0; i < a2.instructions.size(); i++) {
+    auto piece = AssembleInstruction(a2.instructions[i], linker);
+    for (; block != a2.code_blocks.end() && block->begin == i; ++block) {
+      linker.Define(block->name, piece);
     }
   }
+}
 
-  // throw here if constant was not found???
+// _sys.flash_addr, 0 if not defined
+std::size_t BaseAddress(const ConstantsTable& constants) {
+  auto flash_addr = constants.Find(SymbolTable::Global().Find("sys"), "flash_addr");
+  return flash_addr != nullptr ? flash_addr->value : 0;
+}
 
-  return constants != nullptr ? constants->value : 0;
+void Assemble(const A2& a2, std::ostream& binary, EImageFormat format, std::ostream* listing) {
+  Linker linker;
+  {
+    A2_PHASE(EPhase::kAssemble);
+    AssembleTable(a2, linker);
+    AssembleCode(a2, linker);
+  }
+  {
+    A2_PHASE(EPhase::kLink);
+    linker.Link(BaseAddress(a2.constants));
+  }
+
+  A2_PHASE(EPhase::kWrite);
+  WriteImage(MakeImage(linker), format, binary);
+  if (listing != nullptr) {
+    WriteListing(a2, linker, *listing);
+  }
 }
 
-using namespace a2;
-void DumpBits(const std::vector<Bits>& a2s) {
-  std::cout << std::endl << "--- bits ---" << std::endl;
+// Assembles entries as StreamA2 hands them over. A code block name is defined on the first
+// instruction after it, like AssembleCode does with the code blocks of an A2.
+class StreamAssembler : public ProgramStream {
+public:
+  explicit StreamAssembler(std::ostream& binary) : binary_(binary) {}
 
-  for (auto& a2 : a2s) {
-    std::cout << a2.tag << ": sz = " << a2.size << ", ";
-    if (a2.resolved) {
-      std::cout << a2.value;
-    } else {
-      std::cout << "[" << a2.link << "]";
+  void OnConstants(const ConstantsTable& constants) override {
+    linker_ = std::make_unique<StreamLinker>(binary_, BaseAddress(constants));
+  }
+
+  void OnTableEntry(const NamedRef& entry) override { AssembleEntry(entry, *linker_.get()); }
+
+  void OnCodeBlock(Symbol name) override { blocks_.push_back(name); }
+
+  void OnInstruction(const Instruction& inst) override {
+    auto piece = AssembleInstruction(inst, *linker_.get());
+    for (auto name : blocks_) {
+      linker_->Define(name, piece);
     }
-    std::cout << std::endl; 
+    blocks_.clear();
+  }
+
+  void Finish() {
+    A2_PHASE(EPhase::kLink);
+    linker_->Finish();
   }
+
+private:
+  std::ostream& binary_;
+  std::unique_ptr<StreamLinker> linker_;
+  std::vector<Symbol> blocks_;      // code blocks waiting for their first instruction
+};
+
+void AssembleStream(std::unique_ptr<SourceBuffer> source, std::ostream& binary, const StreamOptions& options,
+    StreamStats* stats) {
+  StreamAssembler assembler(binary);
+  StreamA2(std::move(source), assembler, options, stats);
+  assembler.Finish();
 }
 
 }
 
-namespace a2 {
+namespace a2test {
 
-void AssembleTable(const A2& a2, std::vector<Bits>& bits) {
-  for (const auto& entry : a2.table) {
-    Bits bit{};
-    bit.tag = entry.name;
-    bit.size = 4;
-
-    /*
-    if (entry.dynamic.empty()) {
-      bit.resolved = true;
-      bit.value = entry.value;
-    } else {
-      bit.link = entry.dynamic;
-    }
-    bits.push_back(bit);
-    */
+using namespace a2;
+
+namespace {
+
+// Assemble without the listing
+std::unique_ptr<SourceBuffer> ReadSource(const std::string& src) {
+  if (src.back() != '\n') {      // a path
+    return SourceBuffer::Map(src);
   }
+  std::stringstream in(src);
+  return SourceBuffer::Read(in);
+}
 
-  // default implementation of reset
+// src is the text of a program or the path of a file
+std::string LinkedImage(const std::string& src) {
+  auto a2 = ParseA2(ReadSource(src));
+  Linker linker;
+  AssembleTable(*a2.get(), linker);
+  AssembleCode(*a2.get(), linker);
+  linker.Link(BaseAddress(a2->constants));
+
+  std::stringstream out;
+  linker.Write(out);
+  return out.str();
+}
 
+std::string StreamedImage(const std::string& src, const StreamOptions& options) {
+  std::stringstream out;
+  AssembleStream(ReadSource(src), out, options);
+  return out.str();
 }
 
-void Assemble(const A2& a2, std::ostream& binary) {
-  std::vector<Bits> bits;
-  AssembleTable(a2, bits);
+void TestStream(int id, const std::string& src, const StreamOptions& options, EParseErrorCode exp_error) {
+  std::stringstream ss;
+  PutTestId(id, ss);
 
-  DumpBits(bits);
+  bool pass = false;
+  try {
+    auto streamed = StreamedImage(src, options);
+    if (exp_error == EParseErrorCode::kSuccess) {
+      auto linked = LinkedImage(src);
+      pass = AssertEqual("size", linked.size(), streamed.size(), ss) && AssertEqual("image", ToHexStr(HashText(linked), true), ToHexStr(HashText(streamed), true), ss);
+    } else {
+      ExceptionNotThrown(gEParseErrorCodeToStr[exp_error], ss);
+    }
+  } catch (const ParseException& pe) {
+    pass = AssertEqual("exception", gEParseErrorCodeToStr[exp_error], gEParseErrorCodeToStr[pe.Code], ss);
+  } catch (...) { UnexpectedException(ss); }
+
+  if (pass) { std::cout << "."; }
+  else { std::cout << std::endl << ss.str(); }
 }
 
 }
 
+void TestAssembler() {
+  PutTestHeader("AssembleStream", std::cout);
+
+  // constants after the code that uses them, forward and backward branches, a tagged literal
+  std::string src =
+      "#table:\n  stack_addr: flash_addr + flash_sz\n  reset_addr: @reset + 0x01\n  size: @end - @reset\n"
+      "reset:\n  loop:\n    MOVS(r0, count)\n    LDR(r1, @value)\n    ADDS(r1, r1, r0)\n    BNE(skip)\n"
+      "    BL(helper)\n  skip:\n    B(loop)\n"
+      "helper:\n    BX(lr)\n  value:\n    NOP\n    NOP\n"
+      "empty:\n"
+      "end:\n    NOP\n"
+      "_sys:\n  flash_addr: 0x08000000\n  flash_sz: 0x4000\n  count: 8\n";
+  TestStream(1, src, {}, EParseErrorCode::kSuccess);
+  TestStream(2, src, {16}, EParseErrorCode::kSuccess);      // every window a line or two
+  TestStream(3, src, {1}, EParseErrorCode::kSuccess);
+  TestStream(4, "main:\n    B(nowhere)\n", {}, EParseErrorCode::kUnknownTag);
+  TestStream(5, "main:\n    MOVS(r0, sys.missing)\n", {}, EParseErrorCode::kUnknownConstant);
+  TestStream(6, "!include missing.a2\nmain:\n    NOP\n", {}, EParseErrorCode::kIncludeNotFound);
+
+  // pipelined, errors raised in each stage: encode, fold, tokenize
+  TestStream(7, src, {16, true}, EParseErrorCode::kSuccess);
+  TestStream(8, "main:\n    B(nowhere)\n", {kStreamWindow, true}, EParseErrorCode::kUnknownTag);
+  TestStream(9, "main:\n    MOVS(r0, sys.missing)\n", {kStreamWindow, true}, EParseErrorCode::kUnknownConstant);
+  TestStream(10, "main:\n    NOP\n   NOP\n", {kStreamWindow, true}, EParseErrorCode::kIndentCount);
+
+  auto dir = std::filesystem::temp_directory_path() / "a2test_stream";
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "sys.a2") << "_sys:\n  flash_addr: 0x08000000\n  count: 8\nshared:\n    BX(lr)\n";
+  std::ofstream(dir / "main.a2") << "!include sys.a2\nmain:\n    MOVS(r0, count)\n    BL(shared)\n";
+  TestStream(11, (dir / "main.a2").string(), {16}, EParseErrorCode::kSuccess);
+  TestStream(12, (dir / "main.a2").string(), {16, true}, EParseErrorCode::kSuccess);
+  std::ofstream(dir / "sys.a2") << "!include main.a2\n";
+  TestStream(13, (dir / "main.a2").string(), {}, EParseErrorCode::kIncludeCycle);
+
+  // a file two includes share is merged once, files are told apart by path and not by text
+  std::ofstream(dir / "sys.a2") << "_sys:\n  count: 8\nshared:\n    BX(lr)\n";
+  std::ofstream(dir / "a.a2") << "!include sys.a2\n";
+  std::ofstream(dir / "b.a2") << "!include sys.a2\n";
+  std::ofstream(dir / "main.a2") << "!include a.a2\n!include b.a2\nmain:\n    MOVS(r0, count)\n    BL(shared)\n";
+  TestStream(14, (dir / "main.a2").string(), {}, EParseErrorCode::kSuccess);
+  std::filesystem::create_directories(dir / "s" / "s");
+  std::ofstream(dir / "x.a2") << "!include s/x.a2\n";
+  std::ofstream(dir / "s" / "x.a2") << "!include s/x.a2\n";
+  std::ofstream(dir / "s" / "s" / "x.a2") << "_sys:\n  count: 8\nshared:\n    BX(lr)\n";
+  std::ofstream(dir / "main.a2") << "!include x.a2\nmain:\n    MOVS(r0, count)\n    BL(shared)\n";
+  TestStream(15, (dir / "main.a2").string(), {}, EParseErrorCode::kSuccess);
+  std::filesystem::remove_all(dir);
+  std::cout << std::endl;
+}
+
+}
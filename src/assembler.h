@@ -1,20 +1,30 @@
 #pragma once
 
 #include <iostream>
-#include <string>
+#include <memory>
 
+#include "image.h"
+#include "linker.h"
+#include "parser.h"
+#include "source.h"
 #include "types.h"
 
 namespace a2 {
 
-struct Bits {
-  int size;             // in bytes
-  unsigned int value;   // assume 32 bits max 
-  bool resolved;
-  std::string link;     // points to other piece (for address)
-  std::string tag;      // lets other piece reference this piece
-};
+// lays the table and code out from _sys.flash_addr (0 if not defined), links and writes the image,
+// and the listing (see WriteListing) if one is given
+void Assemble(const A2& a2, std::ostream& binary, EImageFormat format = EImageFormat::kBin,
+    std::ostream* listing = nullptr);
 
-void Assemble(const A2& a2, std::ostream& binary);
+// Assembles the program while it is parsed (see StreamA2) into the same image as Assemble, with
+// memory that does not grow with the source. The image is patched in place once all code is
+// written, so binary must be seekable (e.g. a file), and the image is always raw binary. Pipelined, encoding and writing is the last
+// stage, on the calling thread.
+void AssembleStream(std::unique_ptr<SourceBuffer> source, std::ostream& binary, const StreamOptions& options = {},
+    StreamStats* stats = nullptr);
 
 }
+
+namespace a2test {
+void TestAssembler();
+}
@@ -0,0 +1,770 @@
+#include "astfile.h"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "exception.h"
+#include "parser.h"
+#include "source.h"
+#include "testutil.h"
+
+namespace {
+
+using namespace a2;
+
+constexpr std::uint32_t kVersion = 1;
+constexpr std::uint32_t kByteOrder = 0x01020304;     // a file written on a host of the other order fails the check
+constexpr char kProgramMagic[4] = {'A', '2', 'P', 'F'};
+constexpr char kModuleMagic[4] = {'A', '2', 'M', 'F'};
+
+enum ESection : std::uint32_t {
+  kStrings,
+  kChars,
+  kRefeds,
+  kSeries,
+  kTable,
+  kInstructions,
+  kCodeBlocks,
+  kNodes,
+  kBits,
+  kRoots,
+  kSources,
+  kBlocks,
+  kConstantLines,
+  kSectionCount
+};
+
+struct FileHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t section_count;
+  std::uint64_t file_size;
+  std::uint64_t key_hash;      // module files: hash and size of the text they were parsed from
+  std::uint64_t key_size;
+};
+
+struct SectionEntry {
+  std::uint64_t offset;        // from the start of the file, a multiple of 8
+  std::uint64_t count;
+  std::uint32_t record_size;
+  std::uint32_t pad;
+};
+
+// Records. Strings and symbols are indices into the string table (0 is the empty string), other
+// references are indices into their own section.
+
+struct StringRecord {
+  std::uint32_t offset;        // into kChars
+  std::uint32_t length;
+};
+
+struct RefedRecord {
+  std::uint8_t type;
+  std::uint8_t op;
+  std::uint16_t pad;
+  std::uint32_t ref;
+  std::uint64_t num;
+};
+
+struct SeriesRecord {
+  std::uint32_t begin;         // into kRefeds
+  std::uint32_t count;
+};
+
+struct NamedRefRecord {
+  std::uint32_t name;
+  std::uint32_t value;         // into kSeries
+  std::uint32_t indent;
+};
+
+struct InstructionRecord {
+  std::uint32_t tag;
+  std::uint32_t func;
+  std::uint32_t args_begin;    // into kSeries
+  std::uint32_t args_count;
+  std::uint32_t indent;
+};
+
+struct CodeBlockRecord {
+  std::uint32_t name;
+  std::uint32_t pad;
+  std::uint64_t begin;
+};
+
+struct NodeRecord {
+  std::uint32_t name;
+  std::uint32_t path;
+  std::uint32_t parent;
+  std::uint32_t first_child;
+  std::uint32_t last_child;
+  std::uint32_t next_sibling;
+  std::uint32_t bits_begin;
+  std::uint32_t bits_end;
+  std::uint64_t value;
+};
+
+struct BitsRecord {
+  std::uint32_t name;
+  std::uint32_t pad;
+  std::uint64_t size;
+};
+
+struct SourceRecord {
+  std::uint32_t path;
+  std::uint32_t pad;
+  std::uint64_t hash;
+  std::uint64_t size;
+};
+
+struct BlockRecord {
+  std::uint32_t type;
+  std::uint32_t name;
+  std::uint32_t include;
+  std::uint32_t constants_begin;   // into kConstantLines
+  std::uint32_t constants_count;
+  std::uint32_t table_begin;       // into kTable
+  std::uint32_t table_count;
+  std::uint32_t instructions_begin;
+  std::uint32_t instructions_count;
+  std::uint32_t pad;
+};
+
+struct ConstantLineRecord {
+  std::uint32_t name;
+  std::uint16_t bits_info;
+  std::uint16_t indent;
+  std::uint64_t value;
+};
+
+constexpr std::uint32_t gRecordSize[kSectionCount] = {
+  sizeof(StringRecord), sizeof(char), sizeof(RefedRecord), sizeof(SeriesRecord), sizeof(NamedRefRecord),
+  sizeof(InstructionRecord), sizeof(CodeBlockRecord), sizeof(NodeRecord), sizeof(BitsRecord),
+  sizeof(std::uint32_t), sizeof(SourceRecord), sizeof(BlockRecord), sizeof(ConstantLineRecord)
+};
+
+std::uint32_t Index(std::size_t i) { return static_cast<std::uint32_t>(i); }
+
+class Writer {
+public:
+  Writer() { strings_.push_back({0, 0}); }
+
+  std::uint32_t Str(std::string_view s) {
+    strings_.push_back({Index(chars_.size()), Index(s.length())});
+    chars_.insert(chars_.end(), s.begin(), s.end());
+    return Index(strings_.size() - 1);
+  }
+
+  std::uint32_t Sym(Symbol symbol) {
+    if (symbol.Empty()) {
+      return 0;
+    }
+    auto itr = symbols_.find(symbol.Id());
+    if (itr != symbols_.end()) {
+      return itr->second;
+    }
+    auto index = Str(symbol.Str());
+    symbols_.emplace(symbol.Id(), index);
+    return index;
+  }
+
+  std::uint32_t Series(const ArithSeries& series) {
+    series_.push_back({Index(refeds_.size()), Index(series.size())});
+    for (auto& refed : series) {
+      refeds_.push_back({static_cast<std::uint8_t>(refed.type), static_cast<std::uint8_t>(refed.op), 0, Sym(refed.ref),
+          static_cast<std::uint64_t>(refed.num)});
+    }
+    return Index(series_.size() - 1);
+  }
+
+  void Table(const std::vector<NamedRef>& table) {
+    for (auto& entry : table) {
+      auto value = Series(entry.value);
+      table_.push_back({Sym(entry.name), value, Index(entry.indent)});
+    }
+  }
+
+  void Instructions(const std::vector<Instruction>& insts) {
+    for (auto& inst : insts) {
+      auto args_begin = Index(series_.size());
+      for (auto& arg : inst.args) {
+        Series(arg);
+      }
+      instructions_.push_back({Sym(inst.tag), Sym(inst.func), args_begin, Index(inst.args.size()), Index(inst.indent)});
+    }
+  }
+
+  void Program(const A2& a2) {
+    Table(a2.table);
+    Instructions(a2.instructions);
+    for (auto& block : a2.code_blocks) {
+      code_blocks_.push_back({Sym(block.name), 0, block.begin});
+    }
+
+    auto& constants = a2.constants;
+    for (std::uint32_t i = 0; i < constants.NodeCount(); i++) {
+      auto& node = constants.Node(i);
+      nodes_.push_back({Sym(node.name), Sym(node.path), node.parent, node.first_child, node.last_child, node.next_sibling,
+          node.bits_begin, node.bits_end, node.value});
+    }
+    for (auto& bits : constants.BitsInfos()) {
+      bits_.push_back({Sym(bits.name), 0, bits.size});
+    }
+    roots_ = constants.Roots();
+
+    for (auto& source : a2.sources) {
+      sources_.push_back({Str(source.path), 0, source.hash, source.size});
+    }
+  }
+
+  void ModuleBlocks(const Module& module) {
+    for (auto& block : module.blocks) {
+      BlockRecord record{};
+      record.type = static_cast<std::uint32_t>(block.type);
+      record.name = Sym(block.name);
+      record.include = block.include.empty() ? 0 : Str(block.include);
+
+      record.constants_begin = Index(constant_lines_.size());
+      record.constants_count = Index(block.constants.size());
+      for (auto& line : block.constants) {
+        constant_lines_.push_back({Sym(line.name), static_cast<std::uint16_t>(line.bits_info ? 1 : 0),
+            static_cast<std::uint16_t>(line.indent), line.value});
+      }
+
+      record.table_begin = Index(table_.size());
+      record.table_count = Index(block.table.size());
+      Table(block.table);
+
+      record.instructions_begin = Index(instructions_.size());
+      record.instructions_count = Index(block.instructions.size());
+      Instructions(block.instructions);
+
+      blocks_.push_back(record);
+    }
+  }
+
+  std::vector<char> Finish(const char (&magic)[4], std::uint64_t key_hash, std::uint64_t key_size) {
+    std::vector<char> out(sizeof(FileHeader) + sizeof(SectionEntry) * kSectionCount);
+    SectionEntry entries[kSectionCount] = {};
+
+    Put(out, entries[kStrings], strings_);
+    Put(out, entries[kChars], chars_);
+    Put(out, entries[kRefeds], refeds_);
+    Put(out, entries[kSeries], series_);
+    Put(out, entries[kTable], table_);
+    Put(out, entries[kInstructions], instructions_);
+    Put(out, entries[kCodeBlocks], code_blocks_);
+    Put(out, entries[kNodes], nodes_);
+    Put(out, entries[kBits], bits_);
+    Put(out, entries[kRoots], roots_);
+    Put(out, entries[kSources], sources_);
+    Put(out, entries[kBlocks], blocks_);
+    Put(out, entries[kConstantLines], constant_lines_);
+
+    FileHeader header{};
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = kVersion;
+    header.byte_order = kByteOrder;
+    header.section_count = kSectionCount;
+    header.file_size = out.size();
+    header.key_hash = key_hash;
+    header.key_size = key_size;
+    std::memcpy(out.data(), &header, sizeof(header));
+    std::memcpy(out.data() + sizeof(header), entries, sizeof(entries));
+    return out;
+  }
+
+private:
+  template<typename T>
+  static void Put(std::vector<char>& out, SectionEntry& entry, const std::vector<T>& records) {
+    out.resize((out.size() + 7) & ~std::size_t(7));
+    entry.offset = out.size();
+    entry.count = records.size();
+    entry.record_size = sizeof(T);
+    auto bytes = reinterpret_cast<const char*>(records.data());
+    out.insert(out.end(), bytes, bytes + records.size() * sizeof(T));
+  }
+
+  std::vector<StringRecord> strings_;
+  std::vector<char> chars_;
+  std::unordered_map<std::uint32_t, std::uint32_t> symbols_;   // symbol id -> string index
+  std::vector<RefedRecord> refeds_;
+  std::vector<SeriesRecord> series_;
+  std::vector<NamedRefRecord> table_;
+  std::vector<InstructionRecord> instructions_;
+  std::vector<CodeBlockRecord> code_blocks_;
+  std::vector<NodeRecord> nodes_;
+  std::vector<BitsRecord> bits_;
+  std::vector<std::uint32_t> roots_;
+  std::vector<SourceRecord> sources_;
+  std::vector<BlockRecord> blocks_;
+  std::vector<ConstantLineRecord> constant_lines_;
+};
+
+bool WriteAtomically(const std::vector<char>& bytes, const std::string& path) {
+  std::error_code ec;
+  auto parent = std::filesystem::path(path).parent_path();
+  if (!parent.empty()) {
+    std::filesystem::create_directories(parent, ec);
+  }
+
+  // threads and processes sharing a cache directory may save the same file at once, each
+  // writes a temp file of its own and the last rename wins
+  static std::atomic<std::uint64_t> temp_count{0};
+#ifdef _WIN32
+  auto pid = _getpid();
+#else
+  auto pid = getpid();
+#endif
+  auto temp = path + "." + std::to_string(pid) + "." + std::to_string(temp_count++) + ".tmp";
+  {
+    std::ofstream fs(temp, std::ios::binary | std::ios::trunc);
+    fs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    fs.close();
+    if (fs.fail()) {
+      std::filesystem::remove(temp, ec);
+      return false;
+    }
+  }
+  std::filesystem::rename(temp, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  return true;
+}
+
+template<typename T>
+struct Records {
+  const T* data = nullptr;
+  std::size_t count = 0;
+
+  const T* begin() const { return data; }
+  const T* end() const { return data + count; }
+  const T& operator[](std::size_t i) const { return data[i]; }
+};
+
+// Reads a mapped file in place. Every index is range checked as it is followed; a bad one marks
+// the file damaged instead of reading out of bounds.
+class Reader {
+public:
+  bool Open(const std::string& path, const char (&magic)[4]) {
+    file_ = SourceBuffer::Map(path);
+    if (!file_) {
+      return false;
+    }
+
+    auto bytes = file_->Text();
+    if (bytes.length() < sizeof(FileHeader) + sizeof(SectionEntry) * kSectionCount) {
+      return false;
+    }
+    std::memcpy(&header_, bytes.data(), sizeof(header_));
+    if (std::memcmp(header_.magic, magic, sizeof(header_.magic)) != 0 || header_.version != kVersion ||
+        header_.byte_order != kByteOrder || header_.section_count != kSectionCount || header_.file_size != bytes.length()) {
+      return false;
+    }
+
+    std::memcpy(entries_, bytes.data() + sizeof(FileHeader), sizeof(entries_));
+    for (std::uint32_t i = 0; i < kSectionCount; i++) {
+      auto& entry = entries_[i];
+      if (entry.record_size != gRecordSize[i] || entry.offset % 8 != 0 || entry.offset > bytes.length() ||
+          entry.count > (bytes.length() - entry.offset) / entry.record_size) {
+        return false;
+      }
+    }
+
+    // names are interned once here, records then only index into symbols_
+    auto strings = Get<StringRecord>(kStrings);
+    auto chars = Get<char>(kChars);
+    symbols_.reserve(strings.count);
+    for (auto& s : strings) {
+      if (s.offset > chars.count || s.length > chars.count - s.offset) {
+        return false;
+      }
+      symbols_.push_back(s.length == 0 ? Symbol() : Intern(std::string_view(chars.data + s.offset, s.length)));
+    }
+    return true;
+  }
+
+  const FileHeader& Header() const { return header_; }
+
+  template<typename T>
+  Records<T> Get(ESection section) const {
+    auto& entry = entries_[section];
+    return {reinterpret_cast<const T*>(file_->Text().data() + entry.offset), static_cast<std::size_t>(entry.count)};
+  }
+
+  Symbol Sym(std::uint32_t index) {
+    if (index >= symbols_.size()) {
+      damaged_ = true;
+      return {};
+    }
+    return symbols_[index];
+  }
+
+  std::string_view Str(std::uint32_t index) {
+    auto strings = Get<StringRecord>(kStrings);
+    if (index >= strings.count) {
+      damaged_ = true;
+      return {};
+    }
+    return std::string_view(Get<char>(kChars).data + strings[index].offset, strings[index].length);
+  }
+
+  // false, and the file damaged, unless [begin, begin + count) lies in a section of size total
+  bool Range(std::size_t begin, std::size_t count, std::size_t total) {
+    damaged_ = damaged_ || begin > total || count > total - begin;
+    return !damaged_;
+  }
+
+  ArithSeries Series(std::uint32_t index) {
+    ArithSeries series;
+    auto all = Get<SeriesRecord>(kSeries);
+    auto refeds = Get<RefedRecord>(kRefeds);
+    if (!Range(index, 1, all.count) || !Range(all[index].begin, all[index].count, refeds.count)) {
+      return series;
+    }
+
+    series.resize(all[index].count);
+    for (std::uint32_t i = 0; i < all[index].count; i++) {
+      auto& r = refeds[all[index].begin + i];
+      if (r.type >= static_cast<std::uint8_t>(ERefedType::kCount) || r.op >= static_cast<std::uint8_t>(ERefedOp::kCount)) {
+        damaged_ = true;
+      }
+      series[i].type = static_cast<ERefedType>(r.type);
+      series[i].op = static_cast<ERefedOp>(r.op);
+      series[i].ref = Sym(r.ref);
+      series[i].num = static_cast<std::size_t>(r.num);
+    }
+    return series;
+  }
+
+  void Table(std::size_t begin, std::size_t count, std::vector<NamedRef>& table) {
+    auto records = Get<NamedRefRecord>(kTable);
+    if (!Range(begin, count, records.count)) {
+      return;
+    }
+    table.reserve(table.size() + count);
+    for (auto i = begin; i < begin + count; i++) {
+      table.push_back({Sym(records[i].name), Series(records[i].value), static_cast<std::size_t>(records[i].indent)});
+    }
+  }
+
+  void Instructions(std::size_t begin, std::size_t count, std::vector<Instruction>& insts) {
+    auto records = Get<InstructionRecord>(kInstructions);
+    if (!Range(begin, count, records.count)) {
+      return;
+    }
+    insts.reserve(insts.size() + count);
+    for (auto i = begin; i < begin + count; i++) {
+      auto& r = records[i];
+      Instruction inst;
+      inst.tag = Sym(r.tag);
+      inst.func = Sym(r.func);
+      inst.indent = static_cast<std::size_t>(r.indent);
+      if (!Range(r.args_begin, r.args_count, Get<SeriesRecord>(kSeries).count)) {
+        return;
+      }
+      inst.args.reserve(r.args_count);
+      for (std::uint32_t a = 0; a < r.args_count; a++) {
+        inst.args.push_back(Series(r.args_begin + a));
+      }
+      insts.push_back(std::move(inst));
+    }
+  }
+
+  bool Damaged() const { return damaged_; }
+
+private:
+  std::unique_ptr<SourceBuffer> file_;
+  FileHeader header_{};
+  SectionEntry entries_[kSectionCount] = {};
+  std::vector<Symbol> symbols_;
+  bool damaged_ = false;
+};
+
+// node links are indices into the node array or kNone
+bool ValidLink(std::uint32_t link, std::size_t count) { return link == ConstantsData::kNone || link < count; }
+
+}
+
+namespace a2 {
+
+bool SaveA2(const A2& a2, const std::string& path) {
+  Writer writer;
+  writer.Program(a2);
+  return WriteAtomically(writer.Finish(kProgramMagic, 0, 0), path);
+}
+
+std::unique_ptr<A2> LoadA2(const std::string& path) {
+  Reader reader;
+  if (!reader.Open(path, kProgramMagic)) {
+    return nullptr;
+  }
+
+  // hashing the sources is what makes a stale file safe to keep around
+  auto a2 = std::make_unique<A2>();
+  for (auto& record : reader.Get<SourceRecord>(kSources)) {
+    auto source_path = std::string(reader.Str(record.path));
+    auto source = SourceBuffer::Map(source_path);
+    if (reader.Damaged() || !source || source->Text().length() != record.size || source->Hash() != record.hash) {
+      return nullptr;
+    }
+    a2->sources.push_back({source_path, record.hash, static_cast<std::size_t>(record.size)});
+  }
+
+  auto node_records = reader.Get<NodeRecord>(kNodes);
+  auto bits_records = reader.Get<BitsRecord>(kBits);
+  std::vector<ConstantsData> nodes(node_records.count);
+  for (std::size_t i = 0; i < node_records.count; i++) {
+    auto& r = node_records[i];
+    auto& node = nodes[i];
+    node.name = reader.Sym(r.name);
+    node.path = reader.Sym(r.path);
+    node.value = static_cast<std::size_t>(r.value);
+    node.parent = r.parent;
+    node.first_child = r.first_child;
+    node.last_child = r.last_child;
+    node.next_sibling = r.next_sibling;
+    node.bits_begin = r.bits_begin;
+    node.bits_end = r.bits_end;
+    if (!ValidLink(r.parent, nodes.size()) || !ValidLink(r.first_child, nodes.size()) ||
+        !ValidLink(r.last_child, nodes.size()) || !ValidLink(r.next_sibling, nodes.size()) ||
+        r.bits_begin > r.bits_end || r.bits_end > bits_records.count) {
+      return nullptr;
+    }
+  }
+
+  std::vector<BitsInfo> bits_info(bits_records.count);
+  for (std::size_t i = 0; i < bits_records.count; i++) {
+    bits_info[i].name = reader.Sym(bits_records[i].name);
+    bits_info[i].size = static_cast<std::size_t>(bits_records[i].size);
+  }
+
+  auto root_records = reader.Get<std::uint32_t>(kRoots);
+  std::vector<std::uint32_t> roots(root_records.begin(), root_records.end());
+  for (auto root : roots) {
+    if (root >= nodes.size()) {
+      return nullptr;
+    }
+  }
+
+  reader.Table(0, reader.Get<NamedRefRecord>(kTable).count, a2->table);
+  reader.Instructions(0, reader.Get<InstructionRecord>(kInstructions).count, a2->instructions);
+
+  for (auto& r : reader.Get<CodeBlockRecord>(kCodeBlocks)) {
+    if (r.begin > a2->instructions.size()) {
+      return nullptr;
+    }
+    a2->code_blocks.push_back({reader.Sym(r.name), static_cast<std::size_t>(r.begin)});
+  }
+
+  if (reader.Damaged()) {
+    return nullptr;
+  }
+  a2->constants.Restore(std::move(nodes), std::move(bits_info), std::move(roots));
+  return a2;
+}
+
+bool SaveModule(const Module& module, std::uint64_t hash, std::size_t size, const std::string& path) {
+  Writer writer;
+  writer.ModuleBlocks(module);
+  return WriteAtomically(writer.Finish(kModuleMagic, hash, size), path);
+}
+
+std::unique_ptr<Module> LoadModule(const std::string& path, std::uint64_t hash, std::size_t size) {
+  Reader reader;
+  if (!reader.Open(path, kModuleMagic) || reader.Header().key_hash != hash || reader.Header().key_size != size) {
+    return nullptr;
+  }
+
+  auto lines = reader.Get<ConstantLineRecord>(kConstantLines);
+  auto blocks = reader.Get<BlockRecord>(kBlocks);
+
+  auto module = std::make_unique<Module>();
+  module->blocks.resize(blocks.count);
+  for (std::size_t i = 0; i < blocks.count; i++) {
+    auto& r = blocks[i];
+    auto& block = module->blocks[i];
+    if (r.type > static_cast<std::uint32_t>(EBlockType::Include) || !reader.Range(r.constants_begin, r.constants_count, lines.count)) {
+      return nullptr;
+    }
+
+    block.type = static_cast<EBlockType>(r.type);
+    block.name = reader.Sym(r.name);
+    if (r.include != 0) {
+      block.include = std::string(reader.Str(r.include));
+    }
+
+    block.constants.reserve(r.constants_count);
+    for (auto l = r.constants_begin; l < r.constants_begin + r.constants_count; l++) {
+      block.constants.push_back({reader.Sym(lines[l].name), static_cast<std::size_t>(lines[l].value),
+          static_cast<std::size_t>(lines[l].indent), lines[l].bits_info != 0});
+    }
+    reader.Table(r.table_begin, r.table_count, block.table);
+    reader.Instructions(r.instructions_begin, r.instructions_count, block.instructions);
+  }
+
+  return reader.Damaged() ? nullptr : std::move(module);
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestAstFile() {
+  PutTestHeader("AstFile", std::cout);
+
+  auto dir = std::filesystem::temp_directory_path() / "a2test_astfile";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  auto src = (dir / "main.a2").string();
+  auto image = (dir / "main.a2p").string();
+
+  auto write_source = [&src](const char* code) {
+    std::ofstream(src, std::ios::binary) << "_c:\n  a: 0x10\n    b: 2\n      .x: 1\n#table:\n  t: a.b + @l\n"
+                                         << "code:\n  l:\n    " << code << "\n";
+  };
+  auto dump = [](const A2& a2) {
+    std::stringstream ss;
+    for (auto& entry : a2.table) {
+      ss << entry.name << "=" << entry.value.size() << ";";
+    }
+    for (auto& inst : a2.instructions) {
+      ss << inst.tag << " " << inst.func << " " << inst.args.size() << ";";
+    }
+    auto node = a2.constants.Find(Intern("a.b"));
+    ss << (node != nullptr ? node->value : 0) << " " << a2.constants.BitsInfos().size() << " " << a2.code_blocks.size();
+    return ss.str();
+  };
+
+  {
+    std::stringstream ss;
+    PutTestId(1, ss);
+    write_source("MOVS(r0, a.b)");
+    auto parsed = ParseA2(SourceBuffer::Map(src));
+    bool pass = AssertEqual("saved", true, SaveA2(*parsed.get(), image), ss);
+    auto loaded = LoadA2(image);
+    pass = pass && AssertEqual("loaded", true, loaded != nullptr, ss) &&
+           AssertEqual("content", dump(*parsed.get()), dump(*loaded.get()), ss) &&
+           AssertEqual("folded arg", parsed->instructions[0].args[1][0].num, loaded->instructions[0].args[1][0].num, ss);
+    if (pass) { std::cout << "."; }
+    else { std::cout << std::endl << ss.str(); }
+  }
+
+  {
+    std::stringstream ss;
+    PutTestId(2, ss);
+    write_source("MOVS(r1, a.b)");                      // same size, other hash
+    if (AssertEqual("stale file loaded", true, LoadA2(image) == nullptr, ss)) { std::cout << "."; }
+    else { std::cout << std::endl << ss.str(); }
+  }
+
+  {
+    std::stringstream ss;
+    PutTestId(3, ss);
+    auto source = SourceBuffer::Map(src);
+    Module module;
+    module.blocks.resize(2);
+    module.blocks[0].type = EBlockType::Include;
+    module.blocks[0].include = "dev.a2";
+    module.blocks[1].type = EBlockType::Constants;
+    module.blocks[1].name = Intern("c");
+    module.blocks[1].constants.push_back({Intern("a"), 0x10, 1, false});
+    module.blocks[1].constants.push_back({Intern("x"), 1, 2, true});
+    auto path = (dir / "main.a2m").string();
+    bool pass = AssertEqual("saved", true, SaveModule(module, source->Hash(), source->Text().length(), path), ss);
+    auto loaded = LoadModule(path, source->Hash(), source->Text().length());
+    pass = pass && AssertEqual("loaded", true, loaded != nullptr, ss) &&
+           AssertEqual("blocks", std::size_t(2), loaded->blocks.size(), ss) &&
+           AssertEqual("include", std::string("dev.a2"), loaded->blocks[0].include, ss) &&
+           AssertEqual("bits info", true, loaded->blocks[1].constants[1].bits_info, ss) &&
+           AssertEqual("other text", true, LoadModule(path, source->Hash() + 1, source->Text().length()) == nullptr, ss);
+    if (pass) { std::cout << "."; }
+    else { std::cout << std::endl << ss.str(); }
+  }
+
+  {
+    std::stringstream ss;
+    PutTestId(4, ss);
+    write_source("MOVS(r0, a.b)");
+    SaveA2(*ParseA2(SourceBuffer::Map(src)).get(), image);
+
+    std::vector<char> bytes(std::filesystem::file_size(image));
+    std::ifstream(image, std::ios::binary).read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    SectionEntry entries[kSectionCount];
+    std::memcpy(entries, bytes.data() + sizeof(FileHeader), sizeof(entries));
+    auto write_image = [&image](const std::vector<char>& data) {
+      std::ofstream(image, std::ios::binary | std::ios::trunc).write(data.data(), static_cast<std::streamsize>(data.size()));
+    };
+
+    auto args = bytes;
+    InstructionRecord inst;                              // args past the end of the series, not reserved up front
+    std::memcpy(&inst, args.data() + entries[kInstructions].offset, sizeof(inst));
+    inst.args_count = 0xffffffff;
+    std::memcpy(args.data() + entries[kInstructions].offset, &inst, sizeof(inst));
+    write_image(args);
+    bool pass = AssertEqual("damaged args loaded", true, LoadA2(image) == nullptr, ss);
+
+    SeriesRecord bad{0x7ffffff0, 4};                     // refeds past the end of their section
+    std::memcpy(bytes.data() + entries[kSeries].offset, &bad, sizeof(bad));
+    write_image(bytes);
+    pass = pass && AssertEqual("damaged file loaded", true, LoadA2(image) == nullptr, ss);
+
+    std::filesystem::resize_file(image, bytes.size() - 4);
+    pass = pass && AssertEqual("truncated file loaded", true, LoadA2(image) == nullptr, ss);
+    if (pass) { std::cout << "."; }
+    else { std::cout << std::endl << ss.str(); }
+  }
+
+  // threads saving the same program at once each finish with a whole file and leave no temp files
+  {
+    std::stringstream ss;
+    PutTestId(5, ss);
+    write_source("MOVS(r0, a.b)");
+    auto parsed = ParseA2(SourceBuffer::Map(src));
+    std::atomic<std::size_t> saved{0};
+    std::vector<std::thread> savers;
+    for (int t = 0; t < 8; t++) {
+      savers.emplace_back([&] {
+        for (int round = 0; round < 16; round++) {
+          saved += SaveA2(*parsed.get(), image) ? 1 : 0;
+        }
+      });
+    }
+    for (auto& saver : savers) {
+      saver.join();
+    }
+    std::size_t files = 0;
+    for (auto& entry : std::filesystem::directory_iterator(dir)) {
+      files += entry.path().extension() == ".tmp" ? 1 : 0;
+    }
+    auto loaded = LoadA2(image);
+    if (AssertEqual("saved", std::size_t(8 * 16), saved.load(), ss) &&
+        AssertEqual("temp files", std::size_t(0), files, ss) &&
+        AssertEqual("content", dump(*parsed.get()), loaded ? dump(*loaded.get()) : std::string(), ss)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss.str();
+    }
+  }
+
+  std::filesystem::remove_all(dir);
+  std::cout << std::endl;
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "module.h"
+#include "types.h"
+
+namespace a2 {
+
+// Binary form of parsed programs and modules. A file is a header, a section table and sections
+// of fixed-size records that refer to each other by index only, so it can be memory-mapped and
+// read in place. Names are stored once in a string table and interned in a single pass on load,
+// every record then maps its string index to the resulting symbol.
+//
+// A program file holds a folded A2 and the sources it was parsed from; it is stale as soon as
+// one of their hashes changes. A module file holds the tokenized blocks of one file and is
+// named after the hash of that file, so it never goes stale.
+
+// returns false if the file cannot be written; the file is replaced atomically
+bool SaveA2(const A2& a2, const std::string& path);
+
+// nullptr if the file is missing, damaged, from another version, or any source changed
+std::unique_ptr<A2> LoadA2(const std::string& path);
+
+bool SaveModule(const Module& module, std::uint64_t hash, std::size_t size, const std::string& path);
+
+// nullptr if the file is missing, damaged, or holds another text than hash and size describe
+std::unique_ptr<Module> LoadModule(const std::string& path, std::uint64_t hash, std::size_t size);
+
+}
+
+namespace a2test {
+void TestAstFile();
+}
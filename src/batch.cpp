@@ -0,0 +1,225 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <unordered_set>
+#include <sstream>
+
+#include "assembler.h"
+#include "astfile.h"
+#include "exception.h"
+#include "module.h"
+#include "parser.h"
+#include "source.h"
+#include "util.h"
+#include "testutil.h"
+
+namespace {
+
+using namespace a2;
+
+// file size of the input, 0 if unknown, to start the big jobs first
+std::uintmax_t InputSize(const std::string& input) {
+  std::error_code error;
+  auto size = std::filesystem::file_size(input, error);
+  return error ? 0 : size;
+}
+
+void RunJob(const BatchJob& job, EImageFormat format, const std::string& cache_dir, BatchResult& result) {
+  auto start = std::chrono::steady_clock::now();
+  try {
+    auto a2 = LoadOrParseA2(job.input, cache_dir, nullptr);
+    if (!a2) {
+      result.error = "cannot find file";
+    } else {
+      std::stringstream image;
+      Assemble(*a2.get(), image, format);
+      auto bytes = image.str();
+      std::ofstream out(job.output, std::ios::binary);
+      if (!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+        result.error = "cannot write " + job.output;
+      } else {
+        result.ok = true;
+        result.bytes = bytes.size();
+      }
+    }
+  } catch (const ParseException& pe) {
+    result.error = gEParseErrorCodeToStr[pe.Code];
+  } catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+namespace a2 {
+
+std::unique_ptr<A2> LoadOrParseA2(const std::string& input, const std::string& cache_dir, ThreadPool* pool,
+    ModuleCache* modules) {
+  std::unique_ptr<A2> a2;
+  std::string image;
+  if (!cache_dir.empty()) {
+    image = (std::filesystem::path(cache_dir) / (ToHexStr(HashText(input), false) + ".a2p")).string();
+    a2 = LoadA2(image);
+    if (a2) {
+      return a2;
+    }
+  }
+
+  auto source = SourceBuffer::Map(input);
+  if (!source) {
+    return nullptr;
+  }
+  a2 = ParseA2(std::move(source), pool, modules);
+  if (!image.empty()) {
+    SaveA2(*a2.get(), image);
+  }
+  return a2;
+}
+
+std::vector<std::string> ExpandBatchInputs(const std::vector<std::string>& args) {
+  std::vector<std::string> inputs;
+  for (auto& arg : args) {
+    if (arg.empty() || arg[0] != '@') {
+      inputs.push_back(arg);
+      continue;
+    }
+
+    std::filesystem::path manifest = arg.substr(1);
+    std::ifstream in(manifest);
+    if (!in) {
+      throw ParseException(EParseErrorCode::kIncludeNotFound);
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+      auto begin = line.find_first_not_of(" \t\r");
+      auto end = line.find_last_not_of(" \t\r");
+      if (begin == std::string::npos || line[begin] == '#') {
+        continue;
+      }
+      inputs.push_back((manifest.parent_path() / line.substr(begin, end - begin + 1)).string());
+    }
+  }
+  return inputs;
+}
+
+std::string BatchOutput(const std::string& input, const std::string& out_dir, EImageFormat format) {
+  std::filesystem::path path = input;
+  path.replace_extension(gImageFormatToStr[format]);
+  if (!out_dir.empty()) {
+    path = std::filesystem::path(out_dir) / path.filename();
+  }
+  return path.string();
+}
+
+std::string DuplicateOutput(const std::vector<BatchJob>& jobs) {
+  std::unordered_set<std::string> outputs;
+  for (auto& job : jobs) {
+    auto output = std::filesystem::absolute(job.output).lexically_normal().string();
+    if (!outputs.insert(output).second) {
+      return job.output;
+    }
+  }
+  return {};
+}
+
+std::vector<BatchResult> AssembleBatch(const std::vector<BatchJob>& jobs, EImageFormat format,
+    const std::string& cache_dir, ThreadPool* pool) {
+  std::vector<std::uintmax_t> sizes;
+  for (auto& job : jobs) {
+    sizes.push_back(InputSize(job.input));
+  }
+  std::vector<std::size_t> order(jobs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&sizes](auto a, auto b) { return sizes[a] > sizes[b]; });
+
+  std::vector<BatchResult> results(jobs.size());
+  auto task = [&](std::size_t i) { RunJob(jobs[order[i]], format, cache_dir, results[order[i]]); };
+  if (pool == nullptr) {
+    for (std::size_t i = 0; i < order.size(); i++) {
+      task(i);
+    }
+  } else {
+    pool->ParallelFor(order.size(), task);
+  }
+  return results;
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestBatch() {
+  PutTestHeader("Batch", std::cout);
+
+  auto dir = std::filesystem::temp_directory_path() / "a2test_batch";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir / "out");
+  auto write = [&dir](const std::string& name, const std::string& text) {
+    std::ofstream(dir / name, std::ios::binary) << text;
+  };
+  write("dev.a2", "_dev:\n  a: 0x10\n");
+  write("one.a2", "!include dev.a2\ncode:\n  MOVS(r0, a)\n");
+  write("two.a2", "!include dev.a2\ncode:\n  MOVS(r1, a + 1)\n  NOP\n");
+  write("bad.a2", "code:\n  MOVS(r0, b)\n");
+  write("list.txt", "# targets\none.a2\n\n  two.a2\nbad.a2\n");
+
+  {
+    std::stringstream ss;
+    PutTestId(1, ss);
+    std::vector<std::string> inputs;
+    try {
+      inputs = ExpandBatchInputs({(dir / "one.a2").string(), "@" + (dir / "list.txt").string()});
+    } catch (...) { UnexpectedException(ss); }
+
+    if (AssertEqual("inputs", std::size_t(4), inputs.size(), ss) &&
+        AssertEqual("manifest", (dir / "two.a2").string(), inputs[2], ss) &&
+        AssertEqual("output", (dir / "out" / "two.hex").string(),
+            BatchOutput(inputs[2], (dir / "out").string(), EImageFormat::kHex), ss) &&
+        AssertEqual("beside", (dir / "bad.bin").string(), BatchOutput(inputs[3], "", EImageFormat::kBin), ss) &&
+        AssertEqual("distinct", std::string(), DuplicateOutput({{"a/x.a2", "a/x.bin"}, {"b/x.a2", "b/x.bin"}}), ss) &&
+        AssertEqual("duplicate", std::string("out/./x.bin"),
+            DuplicateOutput({{"a/x.a2", "out/x.bin"}, {"b/x.a2", "out/./x.bin"}}), ss)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss.str();
+    }
+  }
+
+  {
+    std::stringstream ss;
+    PutTestId(2, ss);
+    std::vector<BatchJob> jobs;
+    for (auto name : {"one", "two", "bad", "missing"}) {
+      auto input = (dir / (std::string(name) + ".a2")).string();
+      jobs.push_back({input, BatchOutput(input, (dir / "out").string(), EImageFormat::kBin)});
+    }
+    ThreadPool pool(3);
+    auto results = AssembleBatch(jobs, EImageFormat::kBin, "", &pool);
+
+    std::stringstream expected;
+    Assemble(*ParseA2(SourceBuffer::Map(jobs[1].input)).get(), expected);
+    std::ifstream two(jobs[1].output, std::ios::binary);
+    std::string image((std::istreambuf_iterator<char>(two)), std::istreambuf_iterator<char>());
+
+    if (AssertEqual("one", true, results[0].ok && results[0].bytes == 2, ss) &&
+        AssertEqual("two", expected.str(), image, ss) &&
+        AssertEqual("bad", std::string("kInvalidOperand"), results[2].error, ss) &&
+        AssertEqual("missing", std::string("cannot find file"), results[3].error, ss)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss.str();
+    }
+  }
+
+  std::filesystem::remove_all(dir);
+  std::cout << std::endl;
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "module.h"
+#include "threadpool.h"
+#include "types.h"
+
+namespace a2 {
+
+// The program parsed from input, loaded from cache_dir instead while none of its sources changed
+// and saved there otherwise (no cache if empty). nullptr if input cannot be read. Blocks are
+// parsed on the pool if there is one, includes go through modules as in ParseA2.
+std::unique_ptr<A2> LoadOrParseA2(const std::string& input, const std::string& cache_dir, ThreadPool* pool,
+    ModuleCache* modules = nullptr);
+
+// Paths as given, except that @file is a manifest: one path per line, relative to the manifest,
+// blank lines and lines starting with # skipped. Throws kIncludeNotFound for a missing manifest.
+std::vector<std::string> ExpandBatchInputs(const std::vector<std::string>& args);
+
+// out_dir/<input stem>.<format>, or input with the extension of the format if out_dir is empty
+std::string BatchOutput(const std::string& input, const std::string& out_dir, EImageFormat format);
+
+struct BatchJob {
+  std::string input;
+  std::string output;
+};
+
+// The first output that two jobs would both write, compared as absolute normalized paths, e.g.
+// a/x.a2 and b/x.a2 into one -o directory. Empty if every output is distinct.
+std::string DuplicateOutput(const std::vector<BatchJob>& jobs);
+
+struct BatchResult {
+  bool ok = false;
+  std::string error;           // error code name, or what could not be read or written
+  std::size_t bytes = 0;       // of the image
+  double ms = 0;
+};
+
+// Assembles every job into its output, one job per pool task (inline without a pool) so files
+// run concurrently while each is parsed on one thread. The pool hands out one job at a time,
+// largest source first, so a big file does not end up alone at the tail. Included files are
+// tokenized once for the whole batch through ModuleCache::Global. A failed job does not stop
+// the others; results are in the order of jobs.
+std::vector<BatchResult> AssembleBatch(const std::vector<BatchJob>& jobs, EImageFormat format,
+    const std::string& cache_dir, ThreadPool* pool);
+
+}
+
+namespace a2test {
+void TestBatch();
+}
@@ -0,0 +1,234 @@
+#include "constants.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "exception.h"
+#include "testutil.h"
+
+namespace {
+
+// multiplying by an odd constant spreads ids that are close together over the low bits
+std::size_t PathSlot(a2::Symbol path, std::size_t mask) { return (path.Id() * 0x9e3779b9u) & mask; }
+
+}
+
+namespace a2 {
+
+void ConstantsTable::Reserve(std::size_t nodes, std::size_t bits_infos) {
+  nodes_.reserve(nodes);
+  bits_info_.reserve(bits_infos);
+}
+
+std::uint32_t ConstantsTable::Root(Symbol block) {
+  auto itr = root_index_.find(block);
+  if (itr != root_index_.end()) {
+    return itr->second;
+  }
+
+  roots_.push_back(Add(ConstantsData::kNone, block, 0));
+  root_index_.emplace(block, roots_.back());
+  return roots_.back();
+}
+
+std::uint32_t ConstantsTable::Add(std::uint32_t parent, Symbol name, std::size_t value) {
+  auto index = static_cast<std::uint32_t>(nodes_.size());
+
+  ConstantsData node;
+  node.name = name;
+  node.value = value;
+  node.parent = parent;
+  node.bits_begin = node.bits_end = static_cast<std::uint32_t>(bits_info_.size());
+  nodes_.push_back(node);
+
+  if (parent != ConstantsData::kNone) {
+    auto& p = nodes_[parent];
+    if (p.last_child == ConstantsData::kNone) {
+      p.first_child = index;
+    } else {
+      nodes_[p.last_child].next_sibling = index;
+    }
+    p.last_child = index;
+  }
+
+  return index;
+}
+
+void ConstantsTable::AddBitsInfo(std::uint32_t node, const BitsInfo& bits_info) {
+  bits_info_.push_back(bits_info);
+  nodes_[node].bits_end = static_cast<std::uint32_t>(bits_info_.size());
+}
+
+void ConstantsTable::Freeze() {
+  std::string path;
+  for (auto& node : nodes_) {     // parents always precede their children
+    if (node.parent == ConstantsData::kNone) { continue; }
+
+    auto& parent = nodes_[node.parent];
+    if (parent.parent == ConstantsData::kNone) {
+      node.path = node.name;
+    } else {
+      path.assign(parent.path.Str()).append(".").append(node.name.Str());
+      node.path = Intern(path);
+    }
+  }
+  BuildIndex();
+}
+
+void ConstantsTable::Restore(std::vector<ConstantsData> nodes, std::vector<BitsInfo> bits_info, std::vector<std::uint32_t> roots) {
+  nodes_ = std::move(nodes);
+  bits_info_ = std::move(bits_info);
+  roots_ = std::move(roots);
+
+  root_index_.clear();
+  for (auto root : roots_) {
+    root_index_.emplace(nodes_[root].name, root);
+  }
+  BuildIndex();
+}
+
+void ConstantsTable::BuildIndex() {
+  std::size_t size = 16;
+  while (size < nodes_.size() * 2) {
+    size *= 2;
+  }
+  index_.assign(size, ConstantsData::kNone);
+
+  auto mask = size - 1;
+  for (std::uint32_t i = 0; i < nodes_.size(); i++) {
+    if (nodes_[i].parent == ConstantsData::kNone) { continue; }
+    auto slot = PathSlot(nodes_[i].path, mask);
+    while (index_[slot] != ConstantsData::kNone && nodes_[index_[slot]].path != nodes_[i].path) {
+      slot = (slot + 1) & mask;
+    }
+    index_[slot] = i;     // a later definition of the path takes the slot over
+  }
+}
+
+const ConstantsData* ConstantsTable::Find(Symbol path) const {
+  if (index_.empty()) {
+    return nullptr;
+  }
+  auto mask = index_.size() - 1;
+  for (auto slot = PathSlot(path, mask); index_[slot] != ConstantsData::kNone; slot = (slot + 1) & mask) {
+    if (nodes_[index_[slot]].path == path) {
+      return &nodes_[index_[slot]];
+    }
+  }
+  return nullptr;
+}
+
+const ConstantsData* ConstantsTable::Find(Symbol block, std::string_view path) const {
+  auto root = root_index_.find(block);
+  if (root == root_index_.end()) {
+    return nullptr;
+  }
+
+  auto node = root->second;
+  while (!path.empty()) {
+    auto dot = std::min(path.find('.'), path.length());
+    auto name = SymbolTable::Global().Find(path.substr(0, dot));
+    path.remove_prefix(std::min(dot + 1, path.length()));
+
+    auto found = ConstantsData::kNone;
+    for (auto i = nodes_[node].first_child; i != ConstantsData::kNone; i = nodes_[i].next_sibling) {
+      if (nodes_[i].name == name) { found = i; }     // a later definition wins
+    }
+    if (found == ConstantsData::kNone) {
+      return nullptr;
+    }
+    node = found;
+  }
+
+  return &nodes_[node];
+}
+
+std::size_t ConstantsTable::Value(Symbol path) const {
+  auto node = Find(path);
+  if (node == nullptr) {
+    throw ParseException(EParseErrorCode::kUnknownConstant);
+  }
+  return node->value;
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestCt(int id, const ConstantsTable& table, const char* path, EParseErrorCode exp_error, std::size_t exp_value) {
+  std::stringstream ss;
+  PutTestId(id, ss);
+
+  bool pass = false;
+  try {
+    auto value = table.Value(Intern(path));
+    if (exp_error == EParseErrorCode::kSuccess) {
+      pass = AssertEqual("value", exp_value, value, ss);
+    } else {
+      ExceptionNotThrown(gEParseErrorCodeToStr[exp_error], ss);
+    }
+  } catch (const ParseException& pe) {
+    pass = AssertEqual("exception", gEParseErrorCodeToStr[exp_error], gEParseErrorCodeToStr[pe.Code], ss);
+  }
+
+  if (pass) { std::cout << "."; }
+  else { std::cout << std::endl << ss.str(); }
+}
+
+void TestConstants() {
+  ConstantsTable table;
+  auto sys = table.Root(Intern("sys"));
+  table.Add(sys, Intern("flash_addr"), 0x80000000);
+  auto preph = table.Root(Intern("preph"));
+  auto ahb1 = table.Add(preph, Intern("ahb1"), 0x40021000);
+  auto rcc = table.Add(ahb1, Intern("rcc"), 0x10);
+  table.Add(rcc, Intern("cr"), 0x04);
+  table.AddBitsInfo(table.Add(rcc, Intern("ahbenr"), 0x14), {Intern("iopaen"), 1});
+  table.Add(table.Root(Intern("sys")), Intern("ram_addr"), 0x20000000);    // block continued
+  table.Freeze();
+
+  PutTestHeader("ConstantsTable", std::cout);
+  TestCt(1, table, "flash_addr", EParseErrorCode::kSuccess, 0x80000000);
+  TestCt(2, table, "ahb1", EParseErrorCode::kSuccess, 0x40021000);
+  TestCt(3, table, "ahb1.rcc.cr", EParseErrorCode::kSuccess, 0x04);
+  TestCt(4, table, "ahb1.rcc.ahbenr", EParseErrorCode::kSuccess, 0x14);
+  TestCt(5, table, "ram_addr", EParseErrorCode::kSuccess, 0x20000000);
+
+  TestCt(10, table, "rcc", EParseErrorCode::kUnknownConstant, 0);
+  TestCt(11, table, "ahb1.rcc.cfgr", EParseErrorCode::kUnknownConstant, 0);
+  TestCt(12, table, "sys.flash_addr", EParseErrorCode::kUnknownConstant, 0);   // block names are not part of the path
+
+  auto in_block = [&table](const char* block, const char* path) { 
+    auto node = table.Find(SymbolTable::Global().Find(block), path);
+    return node != nullptr ? node->value : ~std::size_t(0);
+  };
+  std::stringstream ss;
+  PutTestId(20, ss);
+  if (AssertEqual("sys flash_addr", std::size_t(0x80000000), in_block("sys", "flash_addr"), ss) &&
+      AssertEqual("preph ahb1.rcc.cr", std::size_t(0x04), in_block("preph", "ahb1.rcc.cr"), ss) &&
+      AssertEqual("preph flash_addr", ~std::size_t(0), in_block("preph", "flash_addr"), ss) &&
+      AssertEqual("nope flash_addr", ~std::size_t(0), in_block("nope", "flash_addr"), ss)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss.str();
+  }
+
+  // enough paths to collide in the index, and a later definition of one of them
+  ConstantsTable many;
+  auto big = many.Root(Intern("big"));
+  for (int i = 0; i < 100; i++) {
+    many.Add(big, Intern("c" + std::to_string(i)), i);
+  }
+  many.Add(big, Intern("c7"), 700);
+  many.Freeze();
+  for (int i = 0; i < 100; i++) {
+    TestCt(21, many, ("c" + std::to_string(i)).c_str(), EParseErrorCode::kSuccess, i == 7 ? 700 : i);
+  }
+  TestCt(22, many, "c100", EParseErrorCode::kUnknownConstant, 0);
+  std::cout << std::endl;
+}
+
+}
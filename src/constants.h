@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "symbol.h"
+
+namespace a2 {
+
+struct BitsInfo {
+  Symbol name;
+  std::size_t size = 0;
+};
+
+struct ConstantsData {
+  static constexpr std::uint32_t kNone = ~std::uint32_t(0);
+
+  Symbol name;
+  Symbol path;                      // dotted path below the block, e.g. ahb1.rcc.cr (set by Freeze)
+  std::size_t value = 0;
+  std::uint32_t parent = kNone;     // kNone for a block root
+  std::uint32_t first_child = kNone;
+  std::uint32_t last_child = kNone;
+  std::uint32_t next_sibling = kNone;
+  std::uint32_t bits_begin = 0;     // range in ConstantsTable::BitsInfos()
+  std::uint32_t bits_end = 0;
+};
+
+// All constants blocks of a program in two contiguous arrays (nodes and bits info), linked by index.
+// Once frozen, any reference resolves with a single probe of the path index.
+class ConstantsTable {
+public:
+  // room for this many nodes (roots included) and bits infos, so merging does not regrow the arrays
+  void Reserve(std::size_t nodes, std::size_t bits_infos);
+
+  // root node of a constants block, created on first use so repeated blocks merge
+  std::uint32_t Root(Symbol block);
+
+  std::uint32_t Add(std::uint32_t parent, Symbol name, std::size_t value);
+
+  // bits info must follow the node it describes
+  void AddBitsInfo(std::uint32_t node, const BitsInfo& bits_info);
+
+  // assigns paths and builds the path index, a later definition of the same path wins
+  void Freeze();
+
+  // takes nodes that already carry their paths (e.g. loaded from a file) and builds the index
+  void Restore(std::vector<ConstantsData> nodes, std::vector<BitsInfo> bits_info, std::vector<std::uint32_t> roots);
+
+  // nullptr if the path is not defined
+  const ConstantsData* Find(Symbol path) const;
+
+  // lookup by block name and path below it (e.g. sys, flash_addr), walks the tree
+  const ConstantsData* Find(Symbol block, std::string_view path) const;
+
+  // throws ParseException(kUnknownConstant) if the path is not defined
+  std::size_t Value(Symbol path) const;
+
+  const std::vector<std::uint32_t>& Roots() const { return roots_; }
+  const ConstantsData& Node(std::uint32_t index) const { return nodes_[index]; }
+  std::uint32_t NodeCount() const { return static_cast<std::uint32_t>(nodes_.size()); }
+  const std::vector<BitsInfo>& BitsInfos() const { return bits_info_; }
+
+private:
+  void BuildIndex();
+
+  std::vector<ConstantsData> nodes_;
+  std::vector<BitsInfo> bits_info_;
+  std::vector<std::uint32_t> roots_;
+  std::unordered_map<Symbol, std::uint32_t> root_index_;
+
+  // path -> node, open addressing over node indices (kNone when empty) and at most half full,
+  // so the index is one allocation however many constants there are
+  std::vector<std::uint32_t> index_;
+};
+
+}
+
+namespace a2test {
+void TestConstants();
+}
@@ -0,0 +1,138 @@
+#include "context.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "assembler.h"
+#include "batch.h"
+#include "parser.h"
+#include "testutil.h"
+
+namespace a2 {
+
+Context::Context(const std::string& cache_dir, std::size_t threads) : cache_dir_(cache_dir) {
+  modules_.SetDirectory(cache_dir);
+  if (threads != 1) {
+    pool_ = std::make_unique<ThreadPool>(threads);
+  }
+}
+
+std::unique_ptr<A2> Context::Parse(const std::string& path) {
+  return LoadOrParseA2(path, cache_dir_, pool_.get(), &modules_);
+}
+
+std::unique_ptr<A2> Context::Parse(std::unique_ptr<SourceBuffer> source) {
+  return ParseA2(std::move(source), pool_.get(), &modules_);
+}
+
+std::string Context::Assemble(const A2& a2, EImageFormat format, std::ostream* listing) const {
+  std::stringstream image;
+  a2::Assemble(a2, image, format, listing);
+  return image.str();
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestContext() {
+  PutTestHeader("Context", std::cout);
+
+  auto dir = std::filesystem::temp_directory_path() / "a2test_context";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "dev.a2", std::ios::binary) << "_dev:\n  a: 0x10\n";
+  std::ofstream(dir / "main.a2", std::ios::binary) << "!include dev.a2\ncode:\n  loop:\n    MOVS(r0, a)\n    BNE(loop)\n";
+  auto main = (dir / "main.a2").string();
+
+  {
+    std::stringstream ss;
+    PutTestId(1, ss);
+    Context first;
+    Context second;
+    auto global = ModuleCache::Global().GetStats();
+    std::string image;
+    try {
+      image = first.Assemble(*first.Parse(main).get());
+      first.Parse(main);
+      second.Parse(main);
+    } catch (...) { UnexpectedException(ss); }
+
+    if (AssertEqual("image", std::string("\x10\x20\xfd\xd1", 4), image, ss) &&
+        AssertEqual("first misses", std::size_t(1), first.CacheStats().misses, ss) &&
+        AssertEqual("first hits", std::size_t(1), first.CacheStats().hits, ss) &&
+        AssertEqual("second misses", std::size_t(1), second.CacheStats().misses, ss) &&
+        AssertEqual("global", global.misses + global.hits,
+            ModuleCache::Global().GetStats().misses + ModuleCache::Global().GetStats().hits, ss)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss.str();
+    }
+  }
+
+  // one context used by several threads at once, each with its own program
+  for (std::size_t threads : {1, 4}) {
+    std::stringstream ss;
+    PutTestId(threads == 1 ? 2 : 3, ss);
+    Context context({}, threads);
+    auto expected = context.Assemble(*context.Parse(main).get());
+    std::vector<std::string> images(8);
+    std::vector<std::thread> callers;
+    for (std::size_t t = 0; t < images.size(); t++) {
+      callers.emplace_back([&, t] {
+        try {
+          for (int round = 0; round < 16; round++) {
+            images[t] = context.Assemble(*context.Parse(main).get());
+          }
+        } catch (...) {
+          images[t].clear();
+        }
+      });
+    }
+    for (auto& caller : callers) {
+      caller.join();
+    }
+
+    bool pass = AssertEqual("parses", std::size_t(1 + 8 * 16), context.CacheStats().hits + context.CacheStats().misses, ss);
+    for (std::size_t t = 0; t < images.size() && pass; t++) {
+      pass = AssertEqual("image", expected, images[t], ss);
+    }
+    if (pass) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss.str();
+    }
+  }
+
+  // a capped cache drops the revision of an include that was edited away
+  {
+    std::stringstream ss;
+    PutTestId(4, ss);
+    Context context;
+    context.SetCacheCapacity(20);
+    std::string image;
+    try {
+      context.Parse(main);
+      std::ofstream(dir / "dev.a2", std::ios::binary) << "_dev:\n  a: 0x11\n";
+      image = context.Assemble(*context.Parse(main).get());
+    } catch (...) { UnexpectedException(ss); }
+
+    if (AssertEqual("image", std::string("\x11\x20\xfd\xd1", 4), image, ss) &&
+        AssertEqual("misses", std::size_t(2), context.CacheStats().misses, ss) &&
+        AssertEqual("evictions", std::size_t(1), context.CacheStats().evictions, ss)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss.str();
+    }
+  }
+
+  std::filesystem::remove_all(dir);
+  std::cout << std::endl;
+}
+
+}
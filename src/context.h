@@ -0,0 +1,56 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "image.h"
+#include "module.h"
+#include "source.h"
+#include "threadpool.h"
+#include "types.h"
+
+namespace a2 {
+
+// Entry point for using the assembler as a library, e.g. from a long-running build service.
+// A context owns what the command line keeps process-wide: the cache of included modules and,
+// with a cache directory, programs saved on disk. Contexts do not share state with each other
+// or with ModuleCache::Global(), and every method may be called from any number of threads at
+// once. The one structure all contexts share is the symbol table (SymbolTable::Global()), which
+// only grows, is locked per shard, and keeps every name for the life of the process, so symbols
+// of programs from different contexts can be compared and outlive their context.
+class Context {
+public:
+  // Programs are saved to and loaded from cache_dir (none if empty). With more than one thread,
+  // blocks of a program are tokenized on a pool of the context; concurrent parses take turns on
+  // that pool, so callers that parse many programs at once should leave threads at 1.
+  explicit Context(const std::string& cache_dir = {}, std::size_t threads = 1);
+
+  Context(const Context&) = delete;
+  Context& operator=(const Context&) = delete;
+
+  // nullptr if path cannot be read, throws ParseException for a program that does not parse
+  std::unique_ptr<A2> Parse(const std::string& path);
+
+  // includes are relative to the source's path, or to the working directory if it has none
+  std::unique_ptr<A2> Parse(std::unique_ptr<SourceBuffer> source);
+
+  // the image of the program in format, and its listing if listing is given
+  std::string Assemble(const A2& a2, EImageFormat format = EImageFormat::kBin, std::ostream* listing = nullptr) const;
+
+  // caps the included modules kept in memory, see ModuleCache::SetCapacity
+  void SetCacheCapacity(std::size_t bytes) { modules_.SetCapacity(bytes); }
+
+  ModuleCache::Stats CacheStats() const { return modules_.GetStats(); }
+
+private:
+  std::string cache_dir_;
+  ModuleCache modules_;
+  std::unique_ptr<ThreadPool> pool_;
+};
+
+}
+
+namespace a2test {
+void TestContext();
+}
@@ -2,7 +2,8 @@
 
 #include <exception>
 #include <string>
-#include <unordered_map>
+
+#include "util.h"
 
 namespace a2 {
 
@@ -11,10 +12,35 @@ enum class EParseErrorCode {
   kRegexError,
   kIndentCount,
   kUnexpectedArithOp,
-  kUnexpected
+  kUnexpected,
+  kUnknownConstant,
+  kUnknownTag,
+  kUnknownInstruction,
+  kInvalidOperand,
+  kOutOfRange,
+  kIncludeNotFound,
+  kIncludeCycle,
+  kDuplicateTag,
+  kTooManyNames,
+  kCount
 };
 
-extern std::unordered_map<EParseErrorCode, std::string> gEParseErrorCodeToStr;
+constexpr EnumTable<EParseErrorCode, 14> gEParseErrorCodeToStr = {{
+  "kSuccess",
+  "kRegexError",
+  "kIndentCount",
+  "kUnexpectedArithOp",
+  "kUnexpected",
+  "kUnknownConstant",
+  "kUnknownTag",
+  "kUnknownInstruction",
+  "kInvalidOperand",
+  "kOutOfRange",
+  "kIncludeNotFound",
+  "kIncludeCycle",
+  "kDuplicateTag",
+  "kTooManyNames"
+}};
 
 
 class ParseException : std::exception {
@@ -0,0 +1,320 @@
+#include "image.h"
+
+#include <array>
+#include <sstream>
+#include <string>
+
+#include "exception.h"
+#include "testutil.h"
+
+namespace {
+
+using namespace a2;
+
+// two upper-case digits per byte value, so a byte costs one table load instead of a conversion
+constexpr std::array<std::array<char, 2>, 256> MakeHexDigits() {
+  constexpr char digits[] = "0123456789ABCDEF";
+  std::array<std::array<char, 2>, 256> table{};
+  for (std::size_t i = 0; i < table.size(); i++) {
+    table[i] = {digits[i >> 4], digits[i & 0xf]};
+  }
+  return table;
+}
+
+constexpr auto kHexDigits = MakeHexDigits();
+
+constexpr std::size_t kHexRecordBytes = 16;
+
+enum EHexRecord : std::uint8_t {
+  kHexData = 0x00,
+  kHexEnd = 0x01,
+  kHexLinearAddress = 0x04
+};
+
+void PutHexByte(char*& out, std::uint8_t byte) {
+  out[0] = kHexDigits[byte][0];
+  out[1] = kHexDigits[byte][1];
+  out += 2;
+}
+
+// :LLAAAATT<data>CC, the checksum makes the sum of all bytes of the record 0
+void PutHexRecord(char*& out, EHexRecord type, std::uint16_t address, const std::uint8_t* data, std::size_t size) {
+  *out++ = ':';
+  std::uint8_t sum = static_cast<std::uint8_t>(size + (address >> 8) + address + type);
+  PutHexByte(out, static_cast<std::uint8_t>(size));
+  PutHexByte(out, static_cast<std::uint8_t>(address >> 8));
+  PutHexByte(out, static_cast<std::uint8_t>(address));
+  PutHexByte(out, type);
+  for (std::size_t i = 0; i < size; i++) {
+    PutHexByte(out, data[i]);
+    sum += data[i];
+  }
+  PutHexByte(out, static_cast<std::uint8_t>(-sum));
+  *out++ = '\n';
+}
+
+std::string FormatHex(const Image& image) {
+  auto size = image.bytes.size();
+  auto records = size / kHexRecordBytes + 3 * (size >> 16) + 8;      // data, split at and announcing 64K pages
+  std::string text(size * 2 + records * 16, '\0');
+  auto out = &text[0];
+
+  std::uint32_t page = 0;
+  for (std::size_t i = 0; i < size;) {
+    auto address = image.base + static_cast<std::uint32_t>(i);
+    if (i == 0 || address >> 16 != page) {
+      page = address >> 16;
+      std::uint8_t upper[2] = {static_cast<std::uint8_t>(page >> 8), static_cast<std::uint8_t>(page)};
+      PutHexRecord(out, kHexLinearAddress, 0, upper, 2);
+    }
+
+    // a record stays within its 64K page
+    auto n = std::min({kHexRecordBytes, size - i, std::size_t(0x10000 - (address & 0xffff))});
+    PutHexRecord(out, kHexData, static_cast<std::uint16_t>(address), image.bytes.data() + i, n);
+    i += n;
+  }
+  PutHexRecord(out, kHexEnd, 0, nullptr, 0);
+
+  text.resize(static_cast<std::size_t>(out - text.data()));
+  return text;
+}
+
+// little-endian fields of the ELF structures, appended in declaration order
+class ElfBuffer {
+public:
+  void U8(std::uint8_t v) { bytes_.push_back(v); }
+  void U16(std::uint16_t v) { U8(static_cast<std::uint8_t>(v)); U8(static_cast<std::uint8_t>(v >> 8)); }
+  void U32(std::uint32_t v) { U16(static_cast<std::uint16_t>(v)); U16(static_cast<std::uint16_t>(v >> 16)); }
+  void Append(const void* data, std::size_t size) {
+    auto p = static_cast<const std::uint8_t*>(data);
+    bytes_.insert(bytes_.end(), p, p + size);
+  }
+  void Align(std::size_t align) { bytes_.resize((bytes_.size() + align - 1) / align * align); }
+
+  const std::vector<std::uint8_t>& Bytes() const { return bytes_; }
+
+private:
+  std::vector<std::uint8_t> bytes_;
+};
+
+constexpr std::uint32_t kElfHeaderSize = 52;
+constexpr std::uint32_t kElfProgramHeaderSize = 32;
+constexpr std::uint32_t kElfSectionHeaderSize = 40;
+constexpr std::uint32_t kElfSymbolSize = 16;
+constexpr std::uint16_t kElfMachineArm = 40;
+constexpr std::uint32_t kElfFlagsEabi5 = 0x05000000;
+
+enum EElfSection : std::uint16_t { kElfNull, kElfText, kElfSymtab, kElfStrtab, kElfShstrtab, kElfSections };
+
+// Header, one PT_LOAD program header for the image, the image as .text, its symbols and the
+// section headers. The entry point is the base address, a Cortex-M core starts from the vector
+// table there regardless.
+std::vector<std::uint8_t> FormatElf(const Image& image) {
+  // section names, and the offset of each in .shstrtab
+  const char shstrtab[] = "\0.text\0.symtab\0.strtab\0.shstrtab";
+  const std::uint32_t names[kElfSections] = {0, 1, 7, 15, 23};
+
+  std::string strtab(1, '\0');
+  std::vector<std::uint32_t> name_offsets;
+  name_offsets.reserve(image.symbols.size());
+  for (auto& symbol : image.symbols) {
+    name_offsets.push_back(static_cast<std::uint32_t>(strtab.size()));
+    strtab += symbol.name.Str();
+    strtab += '\0';
+  }
+
+  ElfBuffer elf;
+  auto text_offset = kElfHeaderSize + kElfProgramHeaderSize;
+  auto text_size = static_cast<std::uint32_t>(image.bytes.size());
+  auto symtab_offset = (text_offset + text_size + 3) / 4 * 4;
+  auto symtab_size = static_cast<std::uint32_t>((image.symbols.size() + 1) * kElfSymbolSize);
+  auto strtab_offset = symtab_offset + symtab_size;
+  auto shstrtab_offset = strtab_offset + static_cast<std::uint32_t>(strtab.size());
+  auto sections_offset = (shstrtab_offset + static_cast<std::uint32_t>(sizeof(shstrtab)) + 3) / 4 * 4;
+
+  const std::uint8_t ident[16] = {0x7f, 'E', 'L', 'F', 1 /* 32-bit */, 1 /* little-endian */, 1 /* version */};
+  elf.Append(ident, sizeof(ident));
+  elf.U16(2);                 // executable
+  elf.U16(kElfMachineArm);
+  elf.U32(1);
+  elf.U32(image.base);        // entry
+  elf.U32(kElfHeaderSize);    // program headers
+  elf.U32(sections_offset);
+  elf.U32(kElfFlagsEabi5);
+  elf.U16(kElfHeaderSize);
+  elf.U16(kElfProgramHeaderSize);
+  elf.U16(1);
+  elf.U16(kElfSectionHeaderSize);
+  elf.U16(kElfSections);
+  elf.U16(kElfShstrtab);
+
+  elf.U32(1);                 // PT_LOAD
+  elf.U32(text_offset);
+  elf.U32(image.base);        // virtual and physical address
+  elf.U32(image.base);
+  elf.U32(text_size);         // in the file and in memory
+  elf.U32(text_size);
+  elf.U32(5);                 // readable, executable
+  elf.U32(4);
+
+  elf.Append(image.bytes.data(), image.bytes.size());
+  elf.Align(4);
+
+  elf.Append(std::array<std::uint8_t, kElfSymbolSize>{}.data(), kElfSymbolSize);
+  for (std::size_t i = 0; i < image.symbols.size(); i++) {
+    elf.U32(name_offsets[i]);
+    elf.U32(image.symbols[i].address);
+    elf.U32(0);               // size unknown
+    elf.U8(1 << 4);           // global, no type
+    elf.U8(0);
+    elf.U16(kElfText);
+  }
+  elf.Append(strtab.data(), strtab.size());
+  elf.Append(shstrtab, sizeof(shstrtab));
+  elf.Align(4);
+
+  // name, type, flags, address, offset, size, link, info, alignment, entry size
+  auto section = [&elf, &names](EElfSection s, std::uint32_t type, std::uint32_t flags, std::uint32_t address,
+      std::uint32_t offset, std::uint32_t size, std::uint32_t link, std::uint32_t info, std::uint32_t align,
+      std::uint32_t entry_size) {
+    for (auto v : {names[s], type, flags, address, offset, size, link, info, align, entry_size}) {
+      elf.U32(v);
+    }
+  };
+  section(kElfNull, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  section(kElfText, 1 /* progbits */, 6 /* alloc, exec */, image.base, text_offset, text_size, 0, 0, 4, 0);
+  section(kElfSymtab, 2, 0, 0, symtab_offset, symtab_size, kElfStrtab, 1 /* first global */, 4, kElfSymbolSize);
+  section(kElfStrtab, 3, 0, 0, strtab_offset, static_cast<std::uint32_t>(strtab.size()), 0, 0, 1, 0);
+  section(kElfShstrtab, 3, 0, 0, shstrtab_offset, sizeof(shstrtab), 0, 0, 1, 0);
+  return elf.Bytes();
+}
+
+}
+
+namespace a2 {
+
+bool FindImageFormat(std::string_view name, EImageFormat& format) {
+  for (std::size_t i = 0; i < static_cast<std::size_t>(EImageFormat::kCount); i++) {
+    auto f = static_cast<EImageFormat>(i);
+    if (name == gImageFormatToStr[f]) {
+      format = f;
+      return true;
+    }
+  }
+  return false;
+}
+
+Image MakeImage(const Linker& linker) {
+  Image image;
+  image.bytes = linker.Bytes();
+  if (linker.Base() + image.bytes.size() > 0x100000000ull) {
+    throw ParseException(EParseErrorCode::kOutOfRange);
+  }
+
+  image.base = static_cast<std::uint32_t>(linker.Base());
+  linker.ForEachTag([&image, &linker](Symbol tag, std::uint32_t piece) {
+    image.symbols.push_back({tag, static_cast<std::uint32_t>(linker.Address(piece))});
+  });
+  return image;
+}
+
+void WriteImage(const Image& image, EImageFormat format, std::ostream& out) {
+  switch (format) {
+    case EImageFormat::kBin:
+      out.write(reinterpret_cast<const char*>(image.bytes.data()), static_cast<std::streamsize>(image.bytes.size()));
+      break;
+    case EImageFormat::kHex: {
+      auto text = FormatHex(image);
+      out.write(text.data(), static_cast<std::streamsize>(text.size()));
+      break;
+    }
+    case EImageFormat::kElf: {
+      auto elf = FormatElf(image);
+      out.write(reinterpret_cast<const char*>(elf.data()), static_cast<std::streamsize>(elf.size()));
+      break;
+    }
+    case EImageFormat::kCount:
+      break;
+  }
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+namespace {
+
+std::string Written(const Image& image, EImageFormat format) {
+  std::stringstream out;
+  WriteImage(image, format, out);
+  return out.str();
+}
+
+std::uint32_t ReadU32(const std::string& bytes, std::size_t offset) {
+  std::uint32_t v = 0;
+  for (int i = 3; i >= 0; i--) {
+    v = (v << 8) | static_cast<std::uint8_t>(bytes[offset + i]);
+  }
+  return v;
+}
+
+void TestIm(bool pass, std::stringstream& ss) {
+  if (pass) { std::cout << "."; }
+  else { std::cout << std::endl << ss.str(); }
+}
+
+}
+
+void TestImage() {
+  PutTestHeader("Image", std::cout);
+
+  Linker linker;
+  linker.Add({4, 0x20001000, true, {}, Intern("stack")});
+  linker.Add({2, 0xbf00, true, {}, Intern("reset")});
+  linker.Add({2, 0xe7fe, true, {}, {}});
+  linker.Link(0x0800fffa);      // the last two bytes cross into the next 64K page
+  auto image = MakeImage(linker);
+
+  {
+    std::stringstream ss;
+    PutTestId(1, ss);
+    std::stringstream linked;
+    linker.Write(linked);
+    TestIm(AssertEqual("bin", linked.str(), Written(image, EImageFormat::kBin), ss) &&
+           AssertEqual("symbols", std::size_t(2), image.symbols.size(), ss) &&
+           AssertEqual("reset", 0x0800fffeu, image.symbols[1].address, ss), ss);
+  }
+  {
+    std::stringstream ss;
+    PutTestId(2, ss);
+    TestIm(AssertEqual("hex", std::string(
+        ":020000040800F2\n"
+        ":06FFFA000010002000BF12\n"
+        ":020000040801F1\n"
+        ":02000000FEE719\n"
+        ":00000001FF\n"), Written(image, EImageFormat::kHex), ss), ss);
+  }
+  {
+    std::stringstream ss;
+    PutTestId(3, ss);
+    auto elf = Written(image, EImageFormat::kElf);
+    auto text_offset = ReadU32(elf, 52 + 4);
+    TestIm(AssertEqual("magic", std::string("\x7f" "ELF"), elf.substr(0, 4), ss) &&
+           AssertEqual("entry", 0x0800fffau, ReadU32(elf, 24), ss) &&
+           AssertEqual("load address", 0x0800fffau, ReadU32(elf, 52 + 8), ss) &&
+           AssertEqual("text", Written(image, EImageFormat::kBin), elf.substr(text_offset, image.bytes.size()), ss) &&
+           AssertEqual("strtab", true, elf.find(std::string("\0stack\0reset\0", 13)) != std::string::npos, ss), ss);
+  }
+  {
+    std::stringstream ss;
+    PutTestId(4, ss);
+    EImageFormat format = EImageFormat::kBin;
+    TestIm(AssertEqual("hex", true, FindImageFormat("hex", format) && format == EImageFormat::kHex, ss) &&
+           AssertEqual("unknown", false, FindImageFormat("srec", format), ss), ss);
+  }
+  std::cout << std::endl;
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "linker.h"
+#include "util.h"
+
+namespace a2 {
+
+enum class EImageFormat : std::uint8_t {
+  kBin,     // the bytes only, loaded at the base address
+  kHex,     // Intel HEX, 16 bytes a record
+  kElf,     // 32-bit little-endian ARM executable, one loadable segment and the tags as symbols
+  kCount
+};
+
+constexpr EnumTable<EImageFormat, 3> gImageFormatToStr = {{ "bin", "hex", "elf" }};
+static_assert(NamesAll(gImageFormatToStr));
+
+// false if name is none of gImageFormatToStr
+bool FindImageFormat(std::string_view name, EImageFormat& format);
+
+struct ImageSymbol {
+  Symbol name;
+  std::uint32_t address;
+};
+
+// A linked program laid out in one buffer, what every format is written from.
+struct Image {
+  std::uint32_t base = 0;
+  std::vector<std::uint8_t> bytes;
+  std::vector<ImageSymbol> symbols;     // tags, in the order defined
+};
+
+// valid after linker.Link, throws ParseException with kOutOfRange if the image does not fit
+// a 32-bit address space
+Image MakeImage(const Linker& linker);
+
+// Formats the whole image in memory and writes it with a single call.
+void WriteImage(const Image& image, EImageFormat format, std::ostream& out);
+
+}
+
+namespace a2test {
+void TestImage();
+}
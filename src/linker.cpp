@@ -0,0 +1,319 @@
+#include "linker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <sstream>
+
+#include "exception.h"
+#include "testutil.h"
+
+namespace a2 {
+
+std::uint32_t Linker::Add(const Bits& bits) {
+  auto piece = static_cast<std::uint32_t>(sizes_.size());
+  sizes_.push_back(static_cast<std::uint8_t>(bits.size));
+  values_.push_back(bits.value);
+  links_.push_back(bits.link);
+  tags_.push_back(bits.tag);
+  if (piece % 64 == 0) {
+    unresolved_.push_back(0);
+  }
+  if (!bits.resolved) {
+    unresolved_[piece / 64] |= std::uint64_t(1) << (piece % 64);
+  }
+  if (!bits.tag.Empty()) {
+    Define(bits.tag, piece);
+  }
+  return piece;
+}
+
+void Linker::Define(Symbol tag, std::uint32_t piece) {
+  if (tag.Id() >= tagged_.size()) {
+    tagged_.resize(tag.Id() + 1, kNone);
+  }
+  if (tagged_[tag.Id()] != kNone) {
+    throw ParseException(EParseErrorCode::kDuplicateTag);
+  }
+  defined_.push_back(tag);
+  tagged_[tag.Id()] = piece;
+}
+
+void Linker::Relocate(std::uint32_t piece, Symbol target, ERefedOp op, ERelocKind kind, std::int32_t addend) {
+  if (Resolved(piece) || links_[piece].Empty()) {
+    links_[piece] = target;
+  }
+  unresolved_[piece / 64] |= std::uint64_t(1) << (piece % 64);
+  relocations_.push_back({piece, target, op, kind, addend});
+}
+
+void Linker::Link(std::size_t base) {
+  base_ = base;
+  addresses_.resize(sizes_.size());
+  std::exclusive_scan(sizes_.begin(), sizes_.end(), addresses_.begin(), base);
+
+  for (auto& r : relocations_) {
+    auto target = r.target.Id() < tagged_.size() ? tagged_[r.target.Id()] : kNone;
+    if (target == kNone) {
+      throw ParseException(EParseErrorCode::kUnknownTag);
+    }
+
+    values_[r.piece] = Patch(r, values_[r.piece], addresses_[r.piece], addresses_[target]);
+  }
+
+  std::fill(unresolved_.begin(), unresolved_.end(), 0);
+}
+
+Bits Linker::Piece(std::uint32_t piece) const {
+  return {sizes_[piece], values_[piece], Resolved(piece), links_[piece], tags_[piece]};
+}
+
+unsigned int Linker::Patch(const Relocation& r, unsigned int value, std::size_t address, std::size_t target_address) {
+  if (r.kind == ERelocKind::kAbs32) {
+    auto target = static_cast<unsigned int>(target_address);
+    return r.op == ERefedOp::kSubtract ? value - target : value + target;
+  }
+
+  auto pc = static_cast<std::int64_t>(address) + 4;
+  if (r.kind == ERelocKind::kThumbPcRel8) {
+    pc &= ~std::int64_t(3);
+  }
+  auto offset = static_cast<std::int64_t>(target_address) + r.addend - pc;
+
+  auto check = [offset](std::int64_t min, std::int64_t max, std::int64_t align) {
+    if (offset < min || offset > max || offset % align != 0) {
+      throw ParseException(EParseErrorCode::kOutOfRange);
+    }
+  };
+
+  auto u = static_cast<std::uint32_t>(offset);
+  switch (r.kind) {
+    case ERelocKind::kThumbB8:
+      check(-256, 254, 2);
+      return value | ((u >> 1) & 0xff);
+    case ERelocKind::kThumbB11:
+      check(-2048, 2046, 2);
+      return value | ((u >> 1) & 0x7ff);
+    case ERelocKind::kThumbBL: {
+      check(-(1 << 24), (1 << 24) - 2, 2);
+      std::uint32_t s = (u >> 24) & 1;
+      std::uint32_t j1 = (~(u >> 23) ^ s) & 1;
+      std::uint32_t j2 = (~(u >> 22) ^ s) & 1;
+      std::uint32_t hw1 = (s << 10) | ((u >> 12) & 0x3ff);
+      std::uint32_t hw2 = (j1 << 13) | (j2 << 11) | ((u >> 1) & 0x7ff);
+      return value | hw1 | (hw2 << 16);     // first halfword in the low bits
+    }
+    case ERelocKind::kThumbPcRel8:
+      check(0, 1020, 4);
+      return value | (u >> 2);
+    default:
+      break;
+  }
+
+  throw ParseException(EParseErrorCode::kUnexpected);
+}
+
+std::vector<std::uint8_t> Linker::Bytes() const {
+  // every piece stores all four bytes and advances by its size, so the tail needs slack
+  auto size = std::accumulate(sizes_.begin(), sizes_.end(), std::size_t(0));
+  std::vector<std::uint8_t> bytes(size + sizeof(unsigned int));
+  auto out = bytes.data();
+  for (std::size_t p = 0; p < sizes_.size(); p++) {
+    auto v = values_[p];
+    std::uint8_t le[4] = {static_cast<std::uint8_t>(v), static_cast<std::uint8_t>(v >> 8),
+                          static_cast<std::uint8_t>(v >> 16), static_cast<std::uint8_t>(v >> 24)};
+    std::memcpy(out, le, sizeof(le));
+    out += sizes_[p];
+  }
+  bytes.resize(size);
+  return bytes;
+}
+
+void Linker::Write(std::ostream& binary) const {
+  auto bytes = Bytes();
+  binary.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+StreamLinker::StreamLinker(std::ostream& binary, std::size_t base) : binary_(binary), base_(base), address_(base) {}
+
+std::uint32_t StreamLinker::Add(const Bits& bits) {
+  char bytes[sizeof(bits.value)];
+  for (int i = 0; i < bits.size; i++) {
+    bytes[i] = static_cast<char>((bits.value >> (8 * i)) & 0xff);
+  }
+  binary_.write(bytes, bits.size);
+
+  last_address_ = address_;
+  last_ = bits;
+  address_ += bits.size;
+  count_++;
+  if (!bits.tag.Empty()) {
+    Define(bits.tag, count_ - 1);
+  }
+  return count_ - 1;
+}
+
+void StreamLinker::Define(Symbol tag, std::uint32_t piece) {
+  if (piece + 1 != count_) {
+    throw ParseException(EParseErrorCode::kUnexpected);
+  }
+  if (tag.Id() >= tagged_.size()) {
+    tagged_.resize(tag.Id() + 1, kUndefined);
+  }
+  if (tagged_[tag.Id()] != kUndefined) {
+    throw ParseException(EParseErrorCode::kDuplicateTag);
+  }
+  tagged_[tag.Id()] = last_address_;
+}
+
+void StreamLinker::Relocate(std::uint32_t piece, Symbol target, ERefedOp op, ERelocKind kind, std::int32_t addend) {
+  if (piece + 1 != count_) {
+    throw ParseException(EParseErrorCode::kUnexpected);
+  }
+  fixups_.push_back({last_address_, last_.value, last_.size, {piece, target, op, kind, addend}});
+}
+
+void StreamLinker::Finish() {
+  // relocations of one piece are consecutive and applied in order, as Linker::Link does
+  unsigned int value = 0;
+  for (std::size_t i = 0; i < fixups_.size(); i++) {
+    auto& f = fixups_[i];
+    auto& r = f.relocation;
+    auto target = r.target.Id() < tagged_.size() ? tagged_[r.target.Id()] : kUndefined;
+    if (target == kUndefined) {
+      throw ParseException(EParseErrorCode::kUnknownTag);
+    }
+
+    value = Linker::Patch(r, i > 0 && fixups_[i - 1].address == f.address ? value : f.value, f.address, target);
+    if (i + 1 < fixups_.size() && fixups_[i + 1].address == f.address) {
+      continue;
+    }
+
+    char bytes[sizeof(value)];
+    for (int b = 0; b < f.size; b++) {
+      bytes[b] = static_cast<char>((value >> (8 * b)) & 0xff);
+    }
+    binary_.seekp(static_cast<std::streamoff>(f.address - base_));
+    binary_.write(bytes, f.size);
+  }
+  binary_.seekp(static_cast<std::streamoff>(address_ - base_));
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestLinker() {
+  PutTestHeader("Linker", std::cout);
+
+  std::stringstream ss;
+  PutTestId(1, ss);
+  Linker linker;
+  auto vec = linker.Add({4, 0x1, true, {}, Intern("vec")});       // @code + 1
+  linker.Relocate(vec, Intern("code"), ERefedOp::kNone);
+  auto diff = linker.Add({4, 0, true, {}, {}});                    // @end - @code
+  linker.Relocate(diff, Intern("end"), ERefedOp::kNone);
+  linker.Relocate(diff, Intern("code"), ERefedOp::kSubtract);
+  auto code = linker.Add({2, 0xbf00, true, {}, {}});
+  linker.Define(Intern("code"), code);
+  linker.Add({2, 0xbf00, true, {}, Intern("end")});
+  linker.Link(0x1000);
+
+  if (AssertEqual("vec", 0x1009u, linker.Value(vec), ss) &&
+      AssertEqual("diff", 0x2u, linker.Value(diff), ss) &&
+      AssertEqual("resolved", true, linker.Resolved(vec) && linker.Resolved(diff), ss) &&
+      AssertEqual("code address", std::size_t(0x1008), linker.Address(code), ss)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss.str();
+  }
+
+  std::stringstream ss2;
+  PutTestId(2, ss2);
+  try {
+    Linker unresolved;
+    unresolved.Relocate(unresolved.Add({4, 0, true, {}, {}}), Intern("nowhere"), ERefedOp::kNone);
+    unresolved.Link(0);
+    ExceptionNotThrown(gEParseErrorCodeToStr[EParseErrorCode::kUnknownTag], ss2);
+    std::cout << std::endl << ss2.str();
+  } catch (const ParseException& pe) {
+    if (AssertEqual("exception", gEParseErrorCodeToStr[EParseErrorCode::kUnknownTag], gEParseErrorCodeToStr[pe.Code], ss2)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss2.str();
+    }
+  }
+
+  // the same pieces streamed, patched in place
+  std::stringstream ss3;
+  PutTestId(3, ss3);
+  std::stringstream streamed;
+  StreamLinker stream(streamed, 0x1000);
+  auto s_vec = stream.Add({4, 0x1, true, {}, Intern("vec")});
+  stream.Relocate(s_vec, Intern("code"), ERefedOp::kNone);
+  auto s_diff = stream.Add({4, 0, true, {}, {}});
+  stream.Relocate(s_diff, Intern("end"), ERefedOp::kNone);
+  stream.Relocate(s_diff, Intern("code"), ERefedOp::kSubtract);
+  stream.Define(Intern("code"), stream.Add({2, 0xbf00, true, {}, {}}));
+  stream.Add({2, 0xbf00, true, {}, Intern("end")});
+  stream.Finish();
+  streamed.put('x');      // Finish leaves the stream at the end of the image
+
+  std::stringstream linked;
+  linker.Write(linked);
+  if (AssertEqual("pending", std::size_t(3), stream.Pending(), ss3) &&
+      AssertEqual("image", linked.str() + "x", streamed.str(), ss3)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss3.str();
+  }
+
+  // a tag defined twice, by Add and by Define, in both linkers
+  std::stringstream ss4;
+  PutTestId(4, ss4);
+  std::string errors;
+  try {
+    Linker twice;
+    twice.Add({2, 0xbf00, true, {}, Intern("twice")});
+    twice.Add({2, 0xbf00, true, {}, Intern("twice")});
+  } catch (const ParseException& pe) {
+    errors += gEParseErrorCodeToStr[pe.Code];
+  }
+  try {
+    std::stringstream out;
+    StreamLinker twice(out, 0);
+    twice.Add({2, 0xbf00, true, {}, Intern("twice")});
+    twice.Define(Intern("twice"), twice.Add({2, 0xbf00, true, {}, {}}));
+  } catch (const ParseException& pe) {
+    errors += std::string(" ") + gEParseErrorCodeToStr[pe.Code];
+  }
+  if (AssertEqual("exceptions", std::string("kDuplicateTag kDuplicateTag"), errors, ss4)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss4.str();
+  }
+
+  // a streamed piece's address is gone once the next one is added
+  std::stringstream ss5;
+  PutTestId(5, ss5);
+  try {
+    std::stringstream out;
+    StreamLinker earlier(out, 0);
+    auto first = earlier.Add({2, 0xbf00, true, {}, {}});
+    earlier.Add({2, 0xbf00, true, {}, {}});
+    earlier.Define(Intern("first"), first);
+    ExceptionNotThrown(gEParseErrorCodeToStr[EParseErrorCode::kUnexpected], ss5);
+    std::cout << std::endl << ss5.str();
+  } catch (const ParseException& pe) {
+    if (AssertEqual("exception", gEParseErrorCodeToStr[EParseErrorCode::kUnexpected], gEParseErrorCodeToStr[pe.Code], ss5)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss5.str();
+    }
+  }
+  std::cout << std::endl;
+}
+
+}
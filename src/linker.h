@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "types.h"
+
+namespace a2 {
+
+enum class ERelocKind : std::uint8_t {
+  kAbs32,         // value +/- target address
+  kThumbB8,       // conditional branch, signed 9-bit offset from pc + 4
+  kThumbB11,      // unconditional branch, signed 12-bit offset from pc + 4
+  kThumbBL,       // BL, signed 25-bit offset from pc + 4, split over both halfwords
+  kThumbPcRel8    // LDR literal / ADR, word offset 0-1020 from pc + 4 aligned down to 4
+};
+
+struct Bits {
+  int size;             // in bytes
+  unsigned int value;   // assume 32 bits max 
+  bool resolved;
+  Symbol link;     // points to other piece (for address)
+  Symbol tag;      // lets other piece reference this piece
+};
+
+// Lays pieces out back to back and patches the ones that refer to the address of another piece.
+// Pieces are kept as columns (sizes, values, an unresolved bitset, links, tags) rather than an
+// array of Bits, so each pass reads only what it uses: addresses are a prefix sum over the sizes,
+// then every relocation patches its piece's value.
+class Linker {
+public:
+  static constexpr std::uint32_t kNone = ~std::uint32_t(0);
+
+  // defines bits.tag too, if set
+  std::uint32_t Add(const Bits& bits);
+
+  // more tags for a piece, e.g. a code block name on its first instruction; throws kDuplicateTag
+  // for a tag that is defined already
+  void Define(Symbol tag, std::uint32_t piece);
+
+  // kAbs32 adds (kNone, kAdd) or subtracts (kSubtract) the address of the piece tagged target,
+  // the pc-relative kinds encode the offset to target + addend into the instruction
+  void Relocate(std::uint32_t piece, Symbol target, ERefedOp op, 
+      ERelocKind kind = ERelocKind::kAbs32, std::int32_t addend = 0);
+
+  // throws ParseException with kUnknownTag if a relocation target was never defined, or
+  // kOutOfRange if a pc-relative offset does not fit its instruction
+  void Link(std::size_t base);
+
+  // little-endian image of all pieces, valid after Link
+  std::vector<std::uint8_t> Bytes() const;
+  void Write(std::ostream& binary) const;
+
+  std::size_t Count() const { return sizes_.size(); }
+  Bits Piece(std::uint32_t piece) const;
+  unsigned int Value(std::uint32_t piece) const { return values_[piece]; }
+  bool Resolved(std::uint32_t piece) const { return (unresolved_[piece / 64] >> (piece % 64) & 1) == 0; }
+  std::size_t Address(std::uint32_t piece) const { return addresses_[piece]; }
+  std::size_t Base() const { return base_; }
+
+  // every tag once, in the order first defined, with the piece it was defined on last
+  template<typename F>
+  void ForEachTag(F f) const {
+    for (auto tag : defined_) {
+      f(tag, tagged_[tag.Id()]);
+    }
+  }
+
+private:
+  friend class StreamLinker;
+
+  struct Relocation {
+    std::uint32_t piece;
+    Symbol target;
+    ERefedOp op;
+    ERelocKind kind;
+    std::int32_t addend;
+  };
+
+  static unsigned int Patch(const Relocation& r, unsigned int value, std::size_t address, std::size_t target_address);
+
+  std::vector<std::uint8_t> sizes_;
+  std::vector<unsigned int> values_;
+  std::vector<std::uint64_t> unresolved_;     // a bit per piece, set while it waits for Link
+  std::vector<Symbol> links_;
+  std::vector<Symbol> tags_;
+  std::vector<std::size_t> addresses_;
+  std::vector<std::uint32_t> tagged_;     // piece of each symbol id, kNone if not a tag
+  std::vector<Symbol> defined_;
+  std::vector<Relocation> relocations_;
+  std::size_t base_ = 0;
+};
+
+// Linker for an image that is written while it is assembled: a piece goes to the stream when it
+// is added, only tag addresses and the pieces waiting for a relocation stay in memory. Finish
+// links those and patches them in place, so the stream must be seekable. Same interface as
+// Linker, except that only the address of the piece added last is kept: Define and Relocate
+// throw kUnexpected for any other piece.
+class StreamLinker {
+public:
+  StreamLinker(std::ostream& binary, std::size_t base);
+
+  std::uint32_t Add(const Bits& bits);
+  void Define(Symbol tag, std::uint32_t piece);
+  void Relocate(std::uint32_t piece, Symbol target, ERefedOp op,
+      ERelocKind kind = ERelocKind::kAbs32, std::int32_t addend = 0);
+
+  // throws like Linker::Link, leaves the stream at the end of the image
+  void Finish();
+
+  std::size_t Pending() const { return fixups_.size(); }
+
+private:
+  static constexpr std::size_t kUndefined = ~std::size_t(0);
+
+  struct Fixup {
+    std::size_t address;      // of the piece
+    unsigned int value;       // as written
+    int size;
+    Linker::Relocation relocation;
+  };
+
+  std::ostream& binary_;
+  std::size_t base_;
+  std::size_t address_;       // of the next piece
+  std::size_t last_address_ = 0;
+  Bits last_{};
+  std::uint32_t count_ = 0;
+  std::vector<std::size_t> tagged_;     // address of each symbol id, kUndefined if not a tag
+  std::vector<Fixup> fixups_;
+};
+
+}
+
+namespace a2test {
+void TestLinker();
+}
@@ -0,0 +1,236 @@
+#include "listing.h"
+
+#include <sstream>
+
+#include "assembler.h"
+#include "parser.h"
+#include "testutil.h"
+
+namespace {
+
+using namespace a2;
+
+constexpr std::size_t kListingChunk = 64 * 1024;
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+// exactly digits digits, zero-padded
+void AppendHex(std::string& out, std::uint64_t n, int digits) {
+  for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+    out += kHexDigits[(n >> shift) & 0xf];
+  }
+}
+
+// 0x and no leading zeros, as ToHexStr
+void AppendHexStr(std::string& out, std::uint64_t n) {
+  int digits = 1;
+  while (digits < 16 && (n >> (digits * 4)) != 0) {
+    digits++;
+  }
+  out += "0x";
+  AppendHex(out, n, digits);
+}
+
+void AppendRefed(std::string& out, const Refed& refed) {
+  if (refed.op != ERefedOp::kNone) {
+    out += gRefedOpToChar[refed.op];
+    out += ' ';
+  }
+
+  switch (refed.type) {
+    case ERefedType::kNum:
+      AppendHexStr(out, refed.num);
+      break;
+    case ERefedType::kAddr:
+      out += '@';
+      out += refed.ref.Str();
+      break;
+    case ERefedType::kConst:
+    case ERefedType::kReg:
+      out += refed.ref.Str();
+      break;
+    default:
+      break;
+  }
+}
+
+}
+
+namespace a2 {
+
+void AppendArithSeries(std::string& out, const ArithSeries& series) {
+  for (std::size_t i = 0; i < series.size(); i++) {
+    if (i > 0) {
+      out += ' ';
+    }
+    AppendRefed(out, series[i]);
+  }
+}
+
+void AppendArgs(std::string& out, const InstructionArgs& args) {
+  for (std::size_t i = 0; i < args.size(); i++) {
+    if (i > 0) {
+      out += ", ";
+    }
+    AppendArithSeries(out, args[i]);
+  }
+}
+
+ListingWriter::ListingWriter(std::ostream& out) : out_(out) {
+  buffer_.reserve(kListingChunk + 4096);
+}
+
+void ListingWriter::Flush() {
+  out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  buffer_.clear();
+}
+
+void ListingWriter::EndLine() {
+  buffer_ += '\n';
+  if (buffer_.size() >= kListingChunk) {
+    Flush();
+  }
+}
+
+void ListingWriter::Constants(const ConstantsTable& constants) {
+  for (auto root : constants.Roots()) {
+    buffer_ += constants.Node(root).name.Str();
+    buffer_ += ": ";
+    AppendHexStr(buffer_, constants.Node(root).value);
+    EndLine();
+    Constants(constants, root, 1);
+    EndLine();
+  }
+}
+
+void ListingWriter::Constants(const ConstantsTable& constants, std::uint32_t node, std::size_t indent) {
+  for (auto i = constants.Node(node).first_child; i != ConstantsData::kNone; i = constants.Node(i).next_sibling) {
+    auto& child = constants.Node(i);
+    buffer_.append(indent * 2, ' ');
+    buffer_ += child.name.Str();
+    buffer_ += ": ";
+    AppendHexStr(buffer_, child.value);
+    EndLine();
+
+    for (auto b = child.bits_begin; b < child.bits_end; b++) {
+      auto& bits_info = constants.BitsInfos()[b];
+      buffer_.append(indent * 2 + 2, ' ');
+      buffer_ += '.';
+      buffer_ += bits_info.name.Str();
+      buffer_ += ": ";
+      AppendHexStr(buffer_, bits_info.size);
+      EndLine();
+    }
+
+    Constants(constants, i, indent + 1);
+  }
+}
+
+// address and encoding columns: a table word, or an instruction's halfwords in memory order
+void ListingWriter::Piece(const Linker& linker, std::uint32_t piece, bool word) {
+  AppendHex(buffer_, linker.Address(piece), 8);
+  buffer_ += "  ";
+  auto bits = linker.Piece(piece);
+  if (word) {
+    AppendHex(buffer_, bits.value, 8);
+    buffer_ += ' ';
+  } else if (bits.size == 2) {
+    AppendHex(buffer_, bits.value, 4);
+    buffer_ += "     ";
+  } else {
+    AppendHex(buffer_, bits.value & 0xffff, 4);
+    buffer_ += ' ';
+    AppendHex(buffer_, bits.value >> 16, 4);
+  }
+  buffer_ += "  ";
+}
+
+void ListingWriter::Program(const A2& a2, const Linker& linker) {
+  buffer_ += "table:";
+  EndLine();
+  std::uint32_t piece = 0;
+  for (auto& entry : a2.table) {
+    Piece(linker, piece++, true);
+    buffer_ += entry.name.Str();
+    buffer_ += ": ";
+    AppendArithSeries(buffer_, entry.value);
+    EndLine();
+  }
+
+  EndLine();
+  buffer_ += "instructions:";
+  EndLine();
+  auto block = a2.code_blocks.begin();
+  for (std::size_t i = 0; i < a2.instructions.size(); i++, piece++) {
+    auto& inst = a2.instructions[i];
+    for (; block != a2.code_blocks.end() && block->begin == i; ++block) {
+      buffer_ += block->name.Str();
+      buffer_ += ':';
+      EndLine();
+    }
+    if (!inst.tag.Empty()) {
+      AppendHex(buffer_, linker.Address(piece), 8);
+      buffer_.append(15, ' ');
+      buffer_ += inst.tag.Str();
+      buffer_ += ':';
+      EndLine();
+    }
+    Piece(linker, piece, false);
+    buffer_ += "    ";
+    buffer_ += inst.func.Str();
+    buffer_ += ' ';
+    AppendArgs(buffer_, inst.args);
+    EndLine();
+  }
+}
+
+void ListingWriter::Symbols(const SymbolTable::Stats& stats) {
+  EndLine();
+  buffer_ += "symbols: " + std::to_string(stats.distinct) + " distinct of " + std::to_string(stats.references) +
+      " references, " + std::to_string(stats.reference_bytes - stats.distinct_bytes) + " of " +
+      std::to_string(stats.reference_bytes) + " name bytes saved";
+  EndLine();
+}
+
+void WriteListing(const A2& a2, const Linker& linker, std::ostream& out) {
+  ListingWriter listing(out);
+  listing.Constants(a2.constants);
+  listing.Program(a2, linker);
+  listing.Symbols(SymbolTable::Global().GetStats());
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestListing() {
+  PutTestHeader("Listing", std::cout);
+
+  std::stringstream ss;
+  PutTestId(1, ss);
+  std::stringstream src(
+      "_sys:\n  flash_addr: 0x08000000\n  count: 8\n    .en: 1\n"
+      "#table:\n  reset_addr: @reset + 1\n"
+      "reset:\n  loop:\n    MOVS(r0, count)\n    BL(loop)\n");
+  std::stringstream listing;
+  std::stringstream image;
+  try {
+    Assemble(*ParseA2(src).get(), image, EImageFormat::kBin, &listing);
+  } catch (...) { UnexpectedException(ss); }
+
+  auto text = listing.str();
+  auto has = [&text](const std::string& line) { return text.find(line + "\n") != std::string::npos; };
+  if (AssertEqual("constant", true, has("  count: 0x8") && has("    .en: 0x1"), ss) &&
+      AssertEqual("entry", true, has("08000000  08000005   reset_addr: @reset + 0x1"), ss) &&
+      AssertEqual("tag", true, has("08000004               loop:"), ss) &&
+      AssertEqual("movs", true, has("08000004  2008           MOVS r0, 0x8"), ss) &&
+      AssertEqual("bl", true, has("08000006  f7ff fffd      BL @loop"), ss)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss.str() << text;
+  }
+  std::cout << std::endl;
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "linker.h"
+#include "types.h"
+
+namespace a2 {
+
+// the text of a series or of instruction arguments, e.g. "@reset + 0x1", appended to out
+void AppendArithSeries(std::string& out, const ArithSeries& series);
+void AppendArgs(std::string& out, const InstructionArgs& args);
+
+// Formats a listing into one buffer that is reused and written out in large chunks, so a big
+// program costs a few writes rather than a flush per line.
+class ListingWriter {
+public:
+  explicit ListingWriter(std::ostream& out);
+  ~ListingWriter() { Flush(); }
+
+  ListingWriter(const ListingWriter&) = delete;
+  ListingWriter& operator=(const ListingWriter&) = delete;
+
+  void Constants(const ConstantsTable& constants);
+
+  // Table entries and instructions with the address and encoded value of their piece. The
+  // pieces are the ones Assemble adds: one per table entry, then one per instruction.
+  void Program(const A2& a2, const Linker& linker);
+
+  void Symbols(const SymbolTable::Stats& stats);
+
+  void Flush();
+
+private:
+  void Constants(const ConstantsTable& constants, std::uint32_t node, std::size_t indent);
+  void Piece(const Linker& linker, std::uint32_t piece, bool word);
+  void EndLine();
+
+  std::ostream& out_;
+  std::string buffer_;
+};
+
+// constants, table, instructions and symbol stats of a linked program
+void WriteListing(const A2& a2, const Linker& linker, std::ostream& out);
+
+}
+
+namespace a2test {
+void TestListing();
+}
@@ -1,37 +1,306 @@
-#include <iostream>
+#include <charconv>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <new>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 #include "types.h"
+#include "smallvector.h"
+#include "source.h"
 #include "parser.h"
 #include "assembler.h"
 #include "tokenizer.h"
+#include "preprocess.h"
+#include "constants.h"
+#include "linker.h"
+#include "thumb.h"
+#include "threadpool.h"
+#include "module.h"
+#include "astfile.h"
+#include "image.h"
+#include "stats.h"
+#include "spscqueue.h"
+#include "listing.h"
+#include "batch.h"
+#include "context.h"
+#include "server.h"
+#include "exception.h"
 
 using namespace a2;
 
+#if A2_STATS
+// counted for --stats
+void* operator new(std::size_t size) {
+  CountAllocation(size);
+  if (auto p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
 void RunTest() {
+  a2test::TestSmallVector();
   a2test::TestTokenizer();
+  a2test::TestPreprocess();
+  a2test::TestConstants();
+  a2test::TestParser();
+  a2test::TestLinker();
+  a2test::TestImage();
+  a2test::TestListing();
+  a2test::TestAssembler();
+  a2test::TestThumb();
+  a2test::TestThreadPool();
+  a2test::TestSpscQueue();
+  a2test::TestStats();
+  a2test::TestAstFile();
+  a2test::TestBatch();
+  a2test::TestContext();
+  a2test::TestServer();
 }
 
 int main(int argc, char* argv[]) {
   if (argc < 2) {
-    std::cout << "usage: a2.exe [input file]" << std::endl;
-    return 0;
+    std::cout << "usage: a2.exe [-j threads] [-c cache dir] [-o image] [-f bin|hex|elf] [-l] [-s] [-p] [--stats] [--trace file] [input file]" << std::endl;
+    std::cout << "       a2.exe --batch [-j threads] [-c cache dir] [-o image dir] [-f bin|hex|elf] [--stats] input files or @manifest..." << std::endl;
+    std::cout << "       a2.exe --serve [-c cache dir] socket" << std::endl;
+    std::cout << "       a2.exe --socket socket [-o image] [-f bin|hex|elf] input file|stats|stop" << std::endl;
+    return 1;
   } else if (argv[1] == std::string("-t")) {
     RunTest();
     return 0;
   }
 
-  std::ifstream fs(argv[1]);
-  if (fs.is_open()) {
-    auto a2 = ParseA2(fs);
-    DumpA2(*a2.get());
+  // -j parses blocks on a thread pool, 0 means one thread per core
+  // -c keeps parsed programs and included modules in a directory, reused while their sources are unchanged
+  // -o writes the image to a file
+  // -f is the format of the image, bin (default), Intel hex or elf
+  // -l prints the listing (constants, table and instructions with their addresses and encodings)
+  // -s streams the source into the image (needs -o) without building the program in memory
+  // -p streams on three threads (tokenize, fold, encode) and prints what each stage did, implies -s
+  // --stats prints time per phase, counters, allocations and peak RSS at the end
+  // --trace writes the phases as Chrome trace-event JSON to a file
+  // --batch assembles every input (or every file an @manifest lists) concurrently on the -j threads,
+  //   into -o dir (or beside the input) named after the input, and fails if any input failed
+  // --serve assembles for clients on a Unix domain socket, keeping included files parsed, until a stop request
+  // --socket has a server assemble the input (-o and -f as without it), or asks it for its stats or to stop
+  int arg = 1;
+  std::unique_ptr<ThreadPool> pool;
+  std::string cache_dir;
+  std::string output;
+  EImageFormat format = EImageFormat::kBin;
+  bool listing = false;
+  bool stream = false;
+  bool batch = false;
+  bool serve = false;
+  std::string socket;
+  bool stats = false;
+  std::string trace;
+  StreamOptions stream_options;
+  for (; arg + 1 < argc; arg++) {
+    std::string option = argv[arg];
+    if (option == "-l") {
+      listing = true;
+    } else if (option == "-s") {
+      stream = true;
+    } else if (option == "-p") {
+      stream = true;
+      stream_options.pipelined = true;
+    } else if (option == "--batch") {
+      batch = true;
+    } else if (option == "--serve") {
+      serve = true;
+    } else if (option == "--stats") {
+      stats = true;
+    } else if (arg + 2 >= argc) {
+      break;
+    } else if (option == "-j") {
+      std::string_view value = argv[++arg];
+      std::size_t threads = 0;
+      auto parsed = std::from_chars(value.data(), value.data() + value.size(), threads);
+      if (parsed.ec != std::errc() || parsed.ptr != value.data() + value.size() || threads == 0) {
+        std::cout << "-j needs a thread count: " << value << std::endl;
+        return 1;
+      }
+      pool = std::make_unique<ThreadPool>(threads);
+    } else if (option == "-c") {
+      cache_dir = argv[++arg];
+    } else if (option == "--socket") {
+      socket = argv[++arg];
+    } else if (option == "--trace") {
+      trace = argv[++arg];
+    } else if (option == "-o") {
+      output = argv[++arg];
+    } else if (option == "-f") {
+      if (!FindImageFormat(argv[++arg], format)) {
+        std::cout << "unknown image format: " << argv[arg] << std::endl;
+        return 1;
+      }
+    } else {
+      break;
+    }
+  }
+
+  if (!cache_dir.empty()) {
+    ModuleCache::Global().SetDirectory(cache_dir);
+  }
+  if (stats || !trace.empty()) {
+    Stats::Global().Enable(!trace.empty());
+  }
+  auto report = [&stats, &trace]() {
+    if (stats) {
+      Stats::Global().Dump(std::cout);
+    }
+    if (!trace.empty()) {
+      std::ofstream json(trace, std::ios::binary);
+      Stats::Global().WriteTrace(json);
+    }
+  };
+
+  if (batch) {
+    if (stream || listing) {
+      std::cout << "--batch does not stream or list" << std::endl;
+      return 1;
+    }
+    std::vector<BatchJob> jobs;
+    try {
+      for (auto& input : ExpandBatchInputs(std::vector<std::string>(argv + arg, argv + argc))) {
+        jobs.push_back({input, BatchOutput(input, output, format)});
+      }
+    } catch (const ParseException&) {
+      std::cout << "cannot find manifest" << std::endl;
+      return 1;
+    }
+    auto duplicate = DuplicateOutput(jobs);
+    if (!duplicate.empty()) {
+      std::cout << "two inputs would both write " << duplicate << std::endl;
+      return 1;
+    }
+    if (!output.empty()) {
+      std::filesystem::create_directories(output);
+    }
 
-    std::stringstream ss;
-    Assemble(*a2.get(), ss);
+    auto results = AssembleBatch(jobs, format, cache_dir, pool.get());
+    std::size_t failed = 0;
+    for (std::size_t i = 0; i < jobs.size(); i++) {
+      if (results[i].ok) {
+        std::cout << jobs[i].input << " -> " << jobs[i].output << ": " << results[i].bytes << " bytes, "
+                  << results[i].ms << " ms" << std::endl;
+      } else {
+        std::cout << jobs[i].input << ": " << results[i].error << std::endl;
+        failed++;
+      }
+    }
+    auto cache = ModuleCache::Global().GetStats();
+    std::cout << jobs.size() - failed << " of " << jobs.size() << " assembled, included files " << cache.misses
+              << " parsed, " << cache.hits << " shared" << std::endl;
+    report();
+    return failed == 0 ? 0 : 1;
   }
-  else {
-	  std::cout << "cannot find file: " << argv[1] << std::endl;
+
+  if (serve) {
+    Context context(cache_dir);
+    context.SetCacheCapacity(kServerCacheBytes);
+    Server server(context, argv[arg]);
+    if (!server.Run()) {
+      std::cout << "cannot listen on " << argv[arg] << std::endl;
+      return 1;
+    }
+    std::cout << server.Stats();
+    report();
+    return 0;
+  }
+
+  if (!socket.empty()) {
+    std::string request = argv[arg];
+    if (request != "stats" && request != "stop") {
+      auto input = std::filesystem::absolute(argv[arg]).string();
+      auto image = output.empty() ? BatchOutput(input, "", format) : std::filesystem::absolute(output).string();
+      request = std::string("assemble\t") + gImageFormatToStr[format] + "\t" + input + "\t" + image;
+    }
+    auto response = ServerRequest(socket, request);
+    if (response.empty()) {
+      std::cout << "cannot reach a server on " << socket << std::endl;
+      return 1;
+    }
+    bool ok = response.rfind("ok\n", 0) == 0;
+    std::cout << (ok ? response.substr(3) : response);
+    return ok ? 0 : 1;
+  }
+
+  auto input = std::filesystem::absolute(argv[arg]).string();
+  if (stream) {
+    auto source = SourceBuffer::Map(input);
+    if (!source || output.empty() || format != EImageFormat::kBin || listing) {
+      std::cout << (!source ? "cannot find file: " + std::string(argv[arg]) : output.empty() ? "-s needs -o" :
+          listing ? "-s keeps no program to list" : "-s writes bin only") << std::endl;
+      return 1;
+    }
+    // the image goes out as it is encoded, so a failed stream leaves no partial file behind
+    // (only a regular file: -o may name a device)
+    auto discard = [&output]() {
+      std::error_code ignored;
+      if (std::filesystem::is_regular_file(output, ignored)) {
+        std::filesystem::remove(output, ignored);
+      }
+    };
+    StreamStats stream_stats;
+    bool written = false;
+    try {
+      std::ofstream binary(output, std::ios::binary);
+      if (binary.is_open()) {
+        AssembleStream(std::move(source), binary, stream_options, &stream_stats);
+        binary.close();
+        written = !binary.fail();
+      }
+    } catch (const ParseException& pe) {
+      discard();
+      std::cout << gEParseErrorCodeToStr[pe.Code] << std::endl;
+      return 1;
+    }
+    if (!written) {
+      discard();
+      std::cout << "cannot write " << output << std::endl;
+      return 1;
+    }
+    if (stream_options.pipelined) {
+      DumpStreamStats(stream_stats);
+    }
+    report();
+    return 0;
+  }
+
+  // the output is only opened once the image is complete
+  std::stringstream image;
+  try {
+    auto a2 = LoadOrParseA2(input, cache_dir, pool.get());
+    if (!a2) {
+      std::cout << "cannot find file: " << argv[arg] << std::endl;
+      return 1;
+    }
+    Assemble(*a2.get(), image, format, listing ? &std::cout : nullptr);
+  } catch (const ParseException& pe) {
+    std::cout << gEParseErrorCodeToStr[pe.Code] << std::endl;
+    return 1;
+  }
+
+  if (!output.empty()) {
+    auto bytes = image.str();
+    std::ofstream binary(output, std::ios::binary);
+    binary.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    binary.close();
+    if (binary.fail()) {
+      std::cout << "cannot write " << output << std::endl;
+      return 1;
+    }
   }
+  report();
+  return 0;
 }
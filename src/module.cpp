@@ -0,0 +1,117 @@
+#include "module.h"
+
+#include <filesystem>
+
+#include "astfile.h"
+#include "util.h"
+
+namespace a2 {
+
+ModuleCache& ModuleCache::Global() {
+  static ModuleCache cache;
+  return cache;
+}
+
+void ModuleCache::SetDirectory(const std::string& dir) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  dir_ = dir;
+}
+
+void ModuleCache::SetCapacity(std::size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_ = bytes;
+  Evict({});
+}
+
+std::shared_ptr<const Module> ModuleCache::Find(std::uint64_t hash, std::size_t size) {
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto itr = modules_.find({hash, size});
+    if (itr != modules_.end()) {
+      stats_.hits++;
+      return Use(itr->second);
+    }
+    if (dir_.empty()) {
+      stats_.misses++;
+      return nullptr;
+    }
+    path = FilePath(hash, size);
+  }
+
+  std::shared_ptr<const Module> module = LoadModule(path, hash, size);     // outside the lock
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!module) {
+    stats_.misses++;
+    return nullptr;
+  }
+  stats_.hits++;
+  stats_.disk_hits++;
+  auto result = modules_.emplace(Key{hash, size}, Entry{std::move(module), 0});
+  module = Use(result.first->second);
+  if (result.second) {
+    bytes_ += size;
+    Evict({hash, size});
+  }
+  return module;
+}
+
+std::shared_ptr<const Module> ModuleCache::Insert(std::uint64_t hash, std::size_t size, std::shared_ptr<const Module> module) {
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto result = modules_.emplace(Key{hash, size}, Entry{std::move(module), 0});
+    module = Use(result.first->second);
+    if (!result.second) {
+      return module;
+    }
+    stats_.parsed_bytes += size;
+    bytes_ += size;
+    Evict({hash, size});
+    if (dir_.empty()) {
+      return module;
+    }
+    path = FilePath(hash, size);
+  }
+
+  SaveModule(*module.get(), hash, size, path);     // a failed save only costs a parse next time
+  return module;
+}
+
+void ModuleCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  modules_.clear();
+  bytes_ = 0;
+}
+
+std::shared_ptr<const Module> ModuleCache::Use(Entry& entry) {
+  entry.used = ++tick_;
+  return entry.module;
+}
+
+// a linear scan per eviction, caches hold few modules and evictions are rare
+void ModuleCache::Evict(const Key& keep) {
+  while (capacity_ != 0 && bytes_ > capacity_ && modules_.size() > 1) {
+    auto oldest = modules_.end();
+    for (auto itr = modules_.begin(); itr != modules_.end(); ++itr) {
+      if (!(itr->first == keep) && (oldest == modules_.end() || itr->second.used < oldest->second.used)) {
+        oldest = itr;
+      }
+    }
+    bytes_ -= oldest->first.size;
+    modules_.erase(oldest);
+    stats_.evictions++;
+  }
+}
+
+ModuleCache::Stats ModuleCache::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+std::string ModuleCache::FilePath(std::uint64_t hash, std::size_t size) const {
+  return (std::filesystem::path(dir_) / (ToHexStr(hash, false) + "-" + ToHexStr(size, false) + ".a2m")).string();
+}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+namespace a2 {
+
+// tokenized line of a constants block, the tree is built when blocks are merged into an A2
+struct ConstantLine {
+  Symbol name;
+  std::size_t value = 0;
+  std::size_t indent = 0;
+  bool bits_info = false;
+};
+
+// Everything tokenized out of one block. Blocks do not depend on each other until they are
+// merged, and hold no views into the source text, so they can outlive it.
+struct ParsedBlock {
+  EBlockType type = EBlockType::None;
+  Symbol name;
+  std::vector<ConstantLine> constants;
+  std::vector<NamedRef> table;
+  std::vector<Instruction> instructions;
+  std::size_t flat_instructions = 0;     // tokenized into the parse's own array instead, see ParseA2
+  std::string include;         // !include path as written, relative to the including file
+};
+
+// blocks of one source file in source order, includes are kept as include blocks
+struct Module {
+  std::vector<ParsedBlock> blocks;
+};
+
+// Parsed modules keyed by a hash of their text, so a file included by many sources is tokenized
+// once per process. Includes are resolved when a module is merged, not when it is cached, so a
+// cached module stays valid when a file it includes changes. Safe to use from several threads.
+class ModuleCache {
+public:
+  struct Stats {
+    std::size_t hits = 0;
+    std::size_t disk_hits = 0;        // hits that were loaded from the directory
+    std::size_t misses = 0;
+    std::size_t parsed_bytes = 0;     // text tokenized on misses
+    std::size_t evictions = 0;
+  };
+
+  static ModuleCache& Global();
+
+  // Also keeps modules as files in dir (see SaveModule), so they outlive the process. Files are
+  // named after the text they were parsed from and are never stale. Empty to turn it off.
+  void SetDirectory(const std::string& dir);
+
+  // nullptr (and a miss) if no module with this text was inserted or saved to the directory
+  std::shared_ptr<const Module> Find(std::uint64_t hash, std::size_t size);
+
+  // keeps the module that was inserted first if two threads parsed the same text
+  std::shared_ptr<const Module> Insert(std::uint64_t hash, std::size_t size, std::shared_ptr<const Module> module);
+
+  // Keeps at most about bytes of source text parsed in memory, evicting the least recently used
+  // modules first (the last one inserted always stays). 0, the default, keeps every module; a
+  // long-running process sets a cap so old revisions of edited files do not pile up.
+  void SetCapacity(std::size_t bytes);
+
+  void Clear();
+
+  Stats GetStats() const;
+
+private:
+  struct Key {
+    std::uint64_t hash;
+    std::size_t size;
+    bool operator==(const Key& other) const { return hash == other.hash && size == other.size; }
+  };
+
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const { return static_cast<std::size_t>(key.hash); }
+  };
+
+  struct Entry {
+    std::shared_ptr<const Module> module;
+    std::uint64_t used;       // tick of the last Find or Insert
+  };
+
+  std::string FilePath(std::uint64_t hash, std::size_t size) const;
+
+  // called with mutex_ held
+  std::shared_ptr<const Module> Use(Entry& entry);
+  void Evict(const Key& keep);
+
+  mutable std::mutex mutex_;
+  std::string dir_;
+  std::unordered_map<Key, Entry, KeyHash> modules_;
+  std::size_t capacity_ = 0;
+  std::size_t bytes_ = 0;         // sizes of the texts of modules_
+  std::uint64_t tick_ = 0;
+  Stats stats_;
+};
+
+}
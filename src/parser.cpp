@@ -1,317 +1,1107 @@
 #include "parser.h"
 
 #include <stack>
-#include <numeric>
 #include <algorithm>
-#include <regex>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 
+#include "exception.h"
+#include "listing.h"
+#include "module.h"
+#include "spscqueue.h"
+#include "stats.h"
 #include "tokenizer.h"
 #include "util.h"
+#include "testutil.h"
 
 namespace {
 
 using namespace a2;
 
-std::unique_ptr<ConstantsData> CreateConstantsData(const std::string& name, unsigned int value = 0) {
-  auto cd = std::make_unique<ConstantsData>();
-  cd->name = name;
-  cd->value = value;
-  return cd;
-}
-
-class LineFetcher {
-public:
-  LineFetcher(std::istream& stream) : stream_(stream), rewind_(false) {}
-  bool Next(std::string& next);
-  void Rewind() { rewind_ = true; }
-  
-private:
-  std::istream& stream_;
-  std::string last_;
-  bool rewind_;
+// A block is a header line (no leading space) and the indented lines up to the next header.
+struct BlockSpan {
+  EBlockType type = EBlockType::None;
+  std::string_view name;
+  std::size_t begin = 0;     // first line after the header
+  std::size_t end = 0;
 };
-  
-class BlockLinesFetcher {
-public:
-  BlockLinesFetcher(LineFetcher& lf) : lf_(lf) {}
-  bool Next(std::string& line);
 
-private:
-  LineFetcher& lf_;
-};
-
-class BlockFetcher {
-public:
-  BlockFetcher(LineFetcher& lf) : lf_(lf) {}
+bool IsBlockHeader(std::string_view line) { return line[0] != ' '; }
 
-  static bool IsBlockHeader(std::string& line) { return line[0] != ' '; }
-
-  bool Next(std::unique_ptr<BlockLinesFetcher>& blf);
-
-  const std::string& GetName() const { return cur_block_name_; }
-
-  EBlockType GetType() const { return cur_block_type_; }
-
-private:
-  LineFetcher& lf_;
-  std::string cur_block_name_;
-  EBlockType cur_block_type_ = EBlockType::None;
-};
-
-bool LineFetcher::Next(std::string& next) {
-  if (rewind_) {
-    next = last_;
-    rewind_ = false;
-    return true;
+// "!include path", the path runs to the end of the line
+std::string_view IncludePath(std::string_view line) {
+  constexpr std::string_view kDirective = "!include";
+  if (line.substr(0, kDirective.length()) != kDirective) {
+    throw ParseException(EParseErrorCode::kUnexpected);
   }
 
-  while (!stream_.eof()) {
-    std::getline(stream_, last_);
-
-    auto from = last_.find_first_not_of(' ');    // tabs are assumed to be converted to spaces with preprocessing
-    auto to = last_.find_last_not_of(' ');
-
-    if (from == std::string::npos) { continue; }
-
-    if (last_[from] == '\'') { continue; }   // comment starts with sigle quote, check first non-blank character
-    
-    last_ = last_.substr(0, to + 1);         // must leave spaces in front
-
-    //std::cout << last_ << std::endl;
+  auto path = line.substr(kDirective.length());
+  auto first = path.find_first_not_of(' ');
+  if (first == 0 || first == std::string_view::npos) {
+    throw ParseException(EParseErrorCode::kUnexpected);
+  }
+  return path.substr(first);
+}
 
-    next = last_;
-    return true;
+// type and name of a block from its header line, the span is left to the caller
+BlockSpan ParseBlockHeader(std::string_view line) {
+  BlockSpan block;
+  std::size_t start = 0;
+  switch (line[0]) {
+    case '_':
+      block.type = EBlockType::Constants;
+      start = 1;
+      break;
+    case '#':
+      block.type = EBlockType::Table;
+      start = 1;
+      break;
+    case '!':
+      block.type = EBlockType::Include;
+      break;
+    default:
+      block.type = EBlockType::Code;
+      break;
   }
 
-  return false;
+  if (block.type == EBlockType::Include) {
+    block.name = IncludePath(line);
+  } else {
+    auto len = line.length() - start - (line.back() == ':' ? 1 : 0);
+    block.name = line.substr(start, len);
+  }
+  return block;
 }
 
-bool BlockFetcher::Next(std::unique_ptr<BlockLinesFetcher>& blf) {
-  std::string line;
-  if (lf_.Next(line)) {
-    if (IsBlockHeader(line)) {
-      blf = std::make_unique<BlockLinesFetcher>(lf_);
+// Lines before the first header are not part of any block and end the program, as before.
+std::vector<BlockSpan> IndexBlocks(const std::vector<SourceLine>& lines) {
+  std::vector<BlockSpan> blocks;
 
-      std::size_t start = 0;
-
-      switch (line[0]) {
-        case '_':
-          cur_block_type_ = EBlockType::Constants;
-          start = 1;
-          break;
-        case '#':
-          cur_block_type_ = EBlockType::Table;
-          start = 1;
-          break;
-        default:
-          cur_block_type_ = EBlockType::Code;
-          break;
+  for (std::size_t i = 0; i < lines.size(); i++) {
+    auto line = lines[i].text;
+    if (!IsBlockHeader(line)) {
+      if (blocks.empty()) {
+        break;
       }
+      continue;
+    }
 
-      auto len = line.length() - start - (line.back() == ':' ? 1 : 0);
-      cur_block_name_ = line.substr(start, len);
-      return true;
-    } else {
-      // not expecting this case, throw exception?
+    if (!blocks.empty()) {
+      blocks.back().end = i;
     }
+
+    auto block = ParseBlockHeader(line);
+    block.begin = i + 1;
+    block.end = lines.size();
+    blocks.push_back(block);
   }
 
-  return false;
+  return blocks;
 }
 
-bool BlockLinesFetcher::Next(std::string& line) {
-  std::string temp;
-  if (lf_.Next(temp)) {
-    if (BlockFetcher::IsBlockHeader(temp)) {
-      lf_.Rewind();
-      return false;
-    } else {
-      line = temp;
-      return true;
+void RethrowFirst(const std::vector<std::exception_ptr>& errors) {
+  for (auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
     }
   }
-
-  return false;
 }
 
 } // end anonymous namespace
 
 namespace a2 {
 
-void ProcConstantsBlock(const std::string& block_name, BlockLinesFetcher& blf, A2& a2) {
-  auto& root = a2.constants[block_name];
-  if (!root) {
-    root = CreateConstantsData(block_name);
+ConstantLine TokenizeConstantLine(const SourceLine& line) {
+  auto nv = TokenizeNamedConstant(line);
+  if (line.text[line.indent] == '.') {
+    return {Intern(nv.name.substr(1)), nv.value, nv.indent, true};
   }
+  return {Intern(nv.name), nv.value, nv.indent, false};
+}
 
-  std::size_t last_indent = 0;
-  std::stack<ConstantsData*> stack;
-  ConstantsData* parent = root.get();
-  ConstantsData* last = root.get();
+void ProcConstantsBlock(const std::vector<SourceLine>& lines, const BlockSpan& span, ParsedBlock& block) {
+  block.name = Intern(span.name);
+  block.constants.reserve(span.end - span.begin);
 
-  std::string line;
-  while (blf.Next(line)) {
+  for (auto i = span.begin; i < span.end; i++) {
+    block.constants.push_back(TokenizeConstantLine(lines[i]));
+  }
+}
 
-    auto nv = TokenizeNamedConstant(line);
+void MergeConstantsBlock(const ParsedBlock& block, ConstantsTable& constants) {
+  std::size_t last_indent = 0;
+  std::stack<std::uint32_t> stack;
+  auto parent = constants.Root(block.name);
+  auto last = parent;
 
-    if (line[nv.indent * INDENT_UNIT] == '.') { 
+  for (auto& nv : block.constants) {
+    if (nv.bits_info) {
       BitsInfo bi;
-      bi.name = nv.name.substr(1, nv.name.length() - 1);
+      bi.name = nv.name;
       bi.size = nv.value;
-      last->bits_info.push_back(bi);
+      constants.AddBitsInfo(last, bi);
       continue; 
     }
 
-    auto temp = CreateConstantsData(nv.name, nv.value);
-    auto p_temp = temp.get();
-
     if (nv.indent == last_indent) {
-      parent->children[nv.name] = std::move(temp);
-      last = p_temp;
+      last = constants.Add(parent, nv.name, nv.value);
     } else if (nv.indent > last_indent) {
-      last->children[nv.name] = std::move(temp);
       stack.push(parent);
       parent = last;
-      last = p_temp;
+      last = constants.Add(parent, nv.name, nv.value);
       last_indent = nv.indent;
     } else if (nv.indent < last_indent) {
-      for (int i = 0; i < last_indent - nv.indent; i++) {
-        last = parent;
+      for (std::size_t i = 0; i < last_indent - nv.indent; i++) {
         parent = stack.top();
         stack.pop();
       }
-      parent->children[nv.name] = std::move(temp);
-      last = p_temp;
+      last = constants.Add(parent, nv.name, nv.value);
       last_indent = nv.indent;
     }
   }
 }
 
-void ProcTableBlock(BlockLinesFetcher& blf, A2& a2) {
-  std::string line;
-  while (blf.Next(line)) {
-    a2.table.push_back(TokenizeNamedRef(line));
+void ProcTableBlock(const std::vector<SourceLine>& lines, const BlockSpan& span, ParsedBlock& block) {
+  block.table.reserve(span.end - span.begin);
+  for (auto i = span.begin; i < span.end; i++) {
+    block.table.push_back(TokenizeNamedRef(lines[i]));
+  }
+}
+
+// A tag line names the instruction that follows it: it only sets last_tag and returns false.
+// Any other line is tokenized into inst, tagged and clears last_tag.
+bool TokenizeCodeLine(const SourceLine& line, Symbol& last_tag, Instruction& inst) {
+  bool is_named_tag = false;
+  Symbol tag;
+  std::tie(is_named_tag, tag) = TryTokenizeNamedTag(line);
+  if (is_named_tag) {
+    last_tag = tag;
+    return false;
+  }
+
+  inst = TokenizeInstruction(line);
+  inst.tag = last_tag;
+  last_tag = {};
+  return true;
+}
+
+// into block.instructions, or into slice (room for a line each) if there is one
+void ProcCodeBlock(const std::vector<SourceLine>& lines, const BlockSpan& span, ParsedBlock& block, Instruction* slice) {
+  block.name = Intern(span.name);
+  if (slice == nullptr) {
+    block.instructions.reserve(span.end - span.begin);
+  }
+
+  Symbol last_tag;
+  Instruction inst;
+  for (auto i = span.begin; i < span.end; i++) {
+    if (!TokenizeCodeLine(lines[i], last_tag, inst)) {
+      continue;
+    }
+    if (slice != nullptr) {
+      slice[block.flat_instructions++] = std::move(inst);
+    } else {
+      block.instructions.push_back(std::move(inst));
+    }
+  }
+}
+
+void ProcBlock(const std::vector<SourceLine>& lines, const BlockSpan& span, ParsedBlock& block,
+    Instruction* slice = nullptr) {
+  A2_PHASE(EPhase::kTokenize);
+  auto count = span.end - span.begin;
+  block.type = span.type;
+  switch (span.type) {
+    case EBlockType::Constants:
+      ProcConstantsBlock(lines, span, block);
+      A2_COUNT(ECounter::kConstantLines, count);
+      A2_COUNT(ECounter::kScans, count);
+      break;
+    case EBlockType::Table:
+      ProcTableBlock(lines, span, block);
+      A2_COUNT(ECounter::kTableLines, count);
+      A2_COUNT(ECounter::kScans, count);
+      break;
+    case EBlockType::Code:
+      ProcCodeBlock(lines, span, block, slice);
+      A2_COUNT(ECounter::kCodeLines, count);
+      A2_COUNT(ECounter::kScans, count + block.instructions.size() + block.flat_instructions);     // tag check, then the instruction
+      break;
+    case EBlockType::Include:
+      if (span.begin != span.end) {     // an include has no body
+        throw ParseException(EParseErrorCode::kUnexpected);
+      }
+      block.include = std::string(span.name);
+      break;
+    default:
+      break;
+  }
+}
+
+// Files by canonical path: those being merged, outermost first, where an include of any of them
+// is a cycle, and those merged in full, which a later include skips.
+struct IncludeStack {
+  std::vector<std::string> paths;
+  std::unordered_set<std::string> merged;
+  ThreadPool* pool;
+  ModuleCache* modules;
+  std::size_t instructions = 0;     // merged so far, the parsed file's code past them is in place already
+};
+
+// Appends a block's contents in source order, so the result does not depend on which thread
+// parsed which block. Blocks of the file being parsed are moved out, cached ones are copied.
+// Code of an include goes in between the code of the parsed file.
+template<typename Block>
+void MergeBlock(Block&& block, IncludeStack& stack, A2& a2) {
+  auto append = [](auto& from, auto& to) {
+    if constexpr (std::is_const_v<std::remove_reference_t<Block>>) {
+      to.insert(to.end(), from.begin(), from.end());
+    } else {
+      to.insert(to.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end()));
+    }
+  };
+
+  switch (block.type) {
+    case EBlockType::Constants:
+      MergeConstantsBlock(block, a2.constants);
+      break;
+    case EBlockType::Table:
+      append(block.table, a2.table);
+      break;
+    case EBlockType::Code:
+      a2.code_blocks.push_back({block.name, stack.instructions});
+      a2.instructions.insert(a2.instructions.begin() + static_cast<std::ptrdiff_t>(stack.instructions),
+          block.instructions.begin(), block.instructions.end());
+      stack.instructions += block.instructions.size() + block.flat_instructions;
+      break;
+    default:
+      break;
+  }
+}
+
+// Tokenizes every block of the source, concurrently with a pool. With code, the instructions
+// of all code blocks go into that one array instead of their blocks (see flat_instructions):
+// each block fills a slice with room for all its lines, and the gaps tag lines leave are closed
+// once every block is done. A parse then holds its code once, in the array the A2 keeps.
+std::unique_ptr<Module> ParseModule(const SourceBuffer& source, ThreadPool* pool,
+    std::vector<Instruction>* code = nullptr) {
+  auto& lines = source.Lines().Lines();
+  auto spans = IndexBlocks(lines);
+
+  auto module = std::make_unique<Module>();
+  module->blocks.resize(spans.size());
+
+  std::vector<std::size_t> slices(spans.size(), 0);
+  if (code != nullptr) {
+    std::size_t room = 0;
+    for (std::size_t i = 0; i < spans.size(); i++) {
+      slices[i] = room;
+      room += spans[i].type == EBlockType::Code ? spans[i].end - spans[i].begin : 0;
+    }
+    code->resize(room);
+  }
+  auto proc = [&](std::size_t i) {
+    ProcBlock(lines, spans[i], module->blocks[i], code != nullptr ? code->data() + slices[i] : nullptr);
+  };
+
+  if (pool == nullptr || pool->Size() == 1) {
+    for (std::size_t i = 0; i < spans.size(); i++) {
+      proc(i);
+    }
+  } else {
+    // an error is reported for the first failing block in source order, as a sequential parse would
+    std::vector<std::exception_ptr> errors(spans.size());
+    pool->ParallelFor(spans.size(), [&](std::size_t i) {
+      try {
+        proc(i);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+    RethrowFirst(errors);
   }
+
+  if (code != nullptr) {
+    auto end = code->begin();
+    for (std::size_t i = 0; i < spans.size(); i++) {
+      auto slice = code->begin() + static_cast<std::ptrdiff_t>(slices[i]);
+      auto count = static_cast<std::ptrdiff_t>(module->blocks[i].flat_instructions);
+      if (slice != end) {
+        std::move(slice, slice + count, end);
+      }
+      end += count;
+    }
+    code->erase(end, code->end());
+  }
+
+  return module;
 }
 
-void ProcCodeBlock(BlockLinesFetcher& blf, A2& a2) {
-  std::string line;
-  std::string last_tag;
-  while (blf.Next(line)) {
-    bool is_named_tag = false;
-    std::string tag;
-    std::tie(is_named_tag, tag) = TryTokenizeNamedTag(line);
-    if (is_named_tag) {
-      last_tag = tag;
+template<typename M>
+void MergeModule(M& module, const std::filesystem::path& dir, IncludeStack& stack, A2& a2);
+
+void MergeInclude(const std::filesystem::path& path, IncludeStack& stack, A2& a2) {
+  auto source = SourceBuffer::Map(path.string());
+  if (!source) {
+    throw ParseException(EParseErrorCode::kIncludeNotFound);
+  }
+
+  std::error_code error;
+  auto canonical = std::filesystem::weakly_canonical(path, error).string();
+  if (std::find(stack.paths.begin(), stack.paths.end(), canonical) != stack.paths.end()) {
+    throw ParseException(EParseErrorCode::kIncludeCycle);
+  }
+  if (stack.merged.count(canonical) != 0) {
+    return;
+  }
+
+  auto hash = source->Hash();
+  auto& cache = *stack.modules;
+  auto module = cache.Find(hash, source->Text().length());
+  if (!module) {
+    module = cache.Insert(hash, source->Text().length(), ParseModule(*source.get(), stack.pool));
+  }
+  a2.sources.push_back({path.string(), hash, source->Text().length()});
+  source.reset();     // the module holds no views into the text
+
+  stack.paths.push_back(canonical);
+  MergeModule(*module.get(), path.parent_path(), stack, a2);
+  stack.paths.pop_back();
+  stack.merged.insert(canonical);
+}
+
+template<typename M>
+void MergeModule(M& module, const std::filesystem::path& dir, IncludeStack& stack, A2& a2) {
+  for (auto& block : module.blocks) {
+    if (block.type == EBlockType::Include) {
+      MergeInclude(dir / block.include, stack, a2);
+    } else if constexpr (std::is_const_v<M>) {
+      MergeBlock(block, stack, a2);
     } else {
-      auto inst = TokenizeInstruction(line);
-      inst.tag = last_tag;
-      a2.instructions.push_back(inst);
-      last_tag.clear();
+      MergeBlock(std::move(block), stack, a2);
+    }
+  }
+}
+
+// Folds numbers and constants into one number and keeps @address terms, which only the linker
+// can resolve: [@addr terms in source order] [number]. The number is dropped if it is 0 and
+// address terms remain. In code, a plain name that is not a constant refers to a tag, and a
+// register name taken alone is a register.
+void FoldArithSeries(ArithSeries& series, const ConstantsTable& constants, bool allow_tags) {
+  if (allow_tags && series.size() == 1 && series[0].type == ERefedType::kConst) {
+    auto reg = RegisterNumber(series[0].ref.Str());
+    if (reg >= 0) {
+      series[0].type = ERefedType::kReg;
+      series[0].num = static_cast<std::size_t>(reg);
+      return;
+    }
+  }
+
+  std::size_t num = 0;
+  std::size_t kept = 0;
+  std::size_t lookups = 0;
+
+  for (auto& refed : series) {
+    std::size_t value = 0;
+    switch (refed.type) {
+      case ERefedType::kNum:
+        value = refed.num;
+        break;
+      case ERefedType::kConst:
+        lookups++;
+        if (auto node = constants.Find(refed.ref)) {
+          value = node->value;
+          break;
+        }
+        if (!allow_tags || refed.ref.Str().find('.') != std::string_view::npos) {
+          throw ParseException(EParseErrorCode::kUnknownConstant);
+        }
+        refed.type = ERefedType::kAddr;
+        series[kept++] = refed;
+        continue;
+      case ERefedType::kAddr:
+        series[kept++] = refed;
+        continue;
+      default:
+        throw ParseException(EParseErrorCode::kUnexpected);
     }
+    num = refed.op == ERefedOp::kSubtract ? num - value : num + value;
   }
+
+  A2_COUNT(ECounter::kConstantLookups, lookups);
+
+  if (kept > 0 && series[0].op == ERefedOp::kAdd) {
+    series[0].op = ERefedOp::kNone;
+  }
+
+  series.resize(kept);
+  if (num != 0 || kept == 0) {
+    series.emplace_back(num, kept == 0 ? ERefedOp::kNone : ERefedOp::kAdd);
+  }
+}
+
+void FoldConstants(A2& a2, ThreadPool* pool) {
+  A2_PHASE(EPhase::kFold);
+  for (auto& entry : a2.table) {
+    FoldArithSeries(entry.value, a2.constants, false);
+  }
+
+  auto fold = [&a2](std::size_t begin, std::size_t end) {
+    for (auto i = begin; i < end; i++) {
+      for (auto& arg : a2.instructions[i].args) {
+        FoldArithSeries(arg, a2.constants, true);
+      }
+    }
+  };
+
+  if (pool == nullptr || pool->Size() == 1) {
+    fold(0, a2.instructions.size());
+    return;
+  }
+
+  // constants are frozen, so folding only reads shared state
+  constexpr std::size_t kChunk = 4096;
+  auto count = (a2.instructions.size() + kChunk - 1) / kChunk;
+  std::vector<std::exception_ptr> errors(count);
+  pool->ParallelFor(count, [&](std::size_t c) {
+    try {
+      fold(c * kChunk, std::min(a2.instructions.size(), (c + 1) * kChunk));
+    } catch (...) {
+      errors[c] = std::current_exception();
+    }
+  });
+  RethrowFirst(errors);
 }
 
 std::unique_ptr<A2> ParseA2(std::istream& from) {
+  return ParseA2(SourceBuffer::Read(from));
+}
+
+std::unique_ptr<A2> ParseA2(std::unique_ptr<SourceBuffer> source, ThreadPool* pool, ModuleCache* modules) {
   auto a2 = std::make_unique<A2>();
 
-  auto lf = LineFetcher(from);
-  auto bf = BlockFetcher(lf);
+  // instructions are large records now that their operands are inline, so the file's code is
+  // tokenized straight into the A2's array rather than copied there block by block
+  auto module = ParseModule(*source.get(), pool, &a2->instructions);
+  a2->sources.push_back({source->Path(), source->Hash(), source->Text().length()});
+
+  // the other arrays are sized for the file's own blocks up front too, included ones may add to them
+  std::size_t nodes = 0, bits_infos = 0, entries = 0, code_blocks = 0;
+  for (auto& block : module->blocks) {
+    nodes += block.type == EBlockType::Constants ? block.constants.size() + 1 : 0;
+    for (auto& line : block.constants) {
+      bits_infos += line.bits_info ? 1 : 0;
+    }
+    entries += block.table.size();
+    code_blocks += block.type == EBlockType::Code ? 1 : 0;
+  }
+  a2->constants.Reserve(nodes, bits_infos);
+  a2->table.reserve(entries);
+  a2->code_blocks.reserve(code_blocks);
+  IncludeStack stack{{}, {}, pool, modules != nullptr ? modules : &ModuleCache::Global()};
+  if (!source->Path().empty()) {
+    std::error_code error;
+    stack.paths.push_back(std::filesystem::weakly_canonical(source->Path(), error).string());
+  }
+  {
+    A2_PHASE(EPhase::kMerge);
+    MergeModule(*module.get(), std::filesystem::path(source->Path()).parent_path(), stack, *a2.get());
+    a2->constants.Freeze();
+  }
+
+  FoldConstants(*a2.get(), pool);
+  return a2;
+}
+
+// Calls f for the lines of the source, indexed a window of whole lines at a time so that the line
+// index never covers the whole text, and evicted once done. Stops early when f returns false.
+template<typename F>
+void ForEachLine(const SourceBuffer& source, std::size_t window, F f) {
+  auto text = source.Text();
+  for (std::size_t begin = 0; begin < text.length();) {
+    auto end = text.length();
+    if (begin + window < text.length()) {
+      auto nl = text.rfind('\n', begin + window - 1);
+      if (nl == std::string_view::npos || nl < begin) {
+        nl = text.find('\n', begin + window);      // a line longer than the window
+      }
+      end = nl == std::string_view::npos ? text.length() : nl + 1;
+    }
+
+    LineIndex index(text.substr(begin, end - begin));
+    for (auto& line : index.Lines()) {
+      if (!f(line)) {
+        return;
+      }
+    }
+    source.Evict(begin, end);
+    begin = end;
+  }
+}
+
+enum class EStreamPass {
+  kConstants,
+  kTable,
+  kCode
+};
+
+struct StreamState {
+  ProgramStream* stream = nullptr;
+  std::size_t window = kStreamWindow;
+  bool fold = true;       // off when a later pipeline stage folds
+  ConstantsTable constants;
+  std::vector<std::string> paths;     // canonical paths of the files being streamed, outermost first
+  std::unordered_set<std::string> streamed[3];     // per pass, included files streamed in full
+  std::unordered_map<std::string, std::unique_ptr<SourceBuffer>> includes;    // mapped by the first pass
+};
+
+void StreamFile(const SourceBuffer& source, const std::filesystem::path& dir, EStreamPass pass, StreamState& state);
+
+// Maps and checks the file in the first pass, later passes find it mapped. As in MergeInclude,
+// a file already streamed in the pass is skipped and an include of one being streamed is a cycle.
+void StreamInclude(const std::filesystem::path& path, EStreamPass pass, StreamState& state) {
+  std::error_code error;
+  auto canonical = std::filesystem::weakly_canonical(path, error).string();
+  if (std::find(state.paths.begin(), state.paths.end(), canonical) != state.paths.end()) {
+    throw ParseException(EParseErrorCode::kIncludeCycle);
+  }
+  auto& streamed = state.streamed[static_cast<std::size_t>(pass)];
+  if (streamed.count(canonical) != 0) {
+    return;
+  }
+
+  auto& source = state.includes[canonical];
+  if (pass == EStreamPass::kConstants) {
+    source = SourceBuffer::Map(path.string());
+    if (!source) {
+      throw ParseException(EParseErrorCode::kIncludeNotFound);
+    }
+  }
+
+  state.paths.push_back(canonical);
+  StreamFile(*source.get(), path.parent_path(), pass, state);
+  state.paths.pop_back();
+  streamed.insert(canonical);
+}
+
+// One pass over a file: the constants pass merges constants blocks and follows includes, the
+// table and code passes fold and stream their entries. Lines of other blocks are skipped.
+void StreamFile(const SourceBuffer& source, const std::filesystem::path& dir, EStreamPass pass, StreamState& state) {
+  A2_PHASE(EPhase::kStream);
+  std::size_t lines = 0;
+  std::size_t scans = 0;
+  auto type = EBlockType::None;
+  ParsedBlock constants;
+  Symbol last_tag;
+  Instruction inst;
+
+  auto end_block = [&]() {
+    if (type == EBlockType::Constants && pass == EStreamPass::kConstants) {
+      MergeConstantsBlock(constants, state.constants);
+    }
+  };
 
-  std::unique_ptr<BlockLinesFetcher> blf;
-  while (bf.Next(blf)) {
-    switch (bf.GetType()) {
+  ForEachLine(source, state.window, [&](const SourceLine& line) {
+    if (IsBlockHeader(line.text)) {
+      end_block();
+      auto header = ParseBlockHeader(line.text);
+      type = header.type;
+      if (type == EBlockType::Include) {
+        StreamInclude(dir / std::string(header.name), pass, state);
+      } else if (type == EBlockType::Constants && pass == EStreamPass::kConstants) {
+        constants.name = Intern(header.name);
+        constants.constants.clear();
+      } else if (type == EBlockType::Code && pass == EStreamPass::kCode) {
+        state.stream->OnCodeBlock(Intern(header.name));
+        last_tag = {};
+      }
+      return true;
+    }
+
+    switch (type) {
+      case EBlockType::None:
+        return false;
+      case EBlockType::Include:
+        throw ParseException(EParseErrorCode::kUnexpected);
       case EBlockType::Constants:
-        ProcConstantsBlock(bf.GetName(), *blf.get(), *a2.get());
+        if (pass == EStreamPass::kConstants) {
+          constants.constants.push_back(TokenizeConstantLine(line));
+          lines++;
+          scans++;
+        }
         break;
       case EBlockType::Table:
-        ProcTableBlock(*blf.get(), *a2.get());
+        if (pass == EStreamPass::kTable) {
+          auto entry = TokenizeNamedRef(line);
+          lines++;
+          scans++;
+          if (state.fold) {
+            FoldArithSeries(entry.value, state.constants, false);
+          }
+          state.stream->OnTableEntry(entry);
+        }
         break;
       case EBlockType::Code:
-        ProcCodeBlock(*blf.get(), *a2.get());
+        if (pass == EStreamPass::kCode) {
+          lines++;
+          scans++;
+        }
+        if (pass == EStreamPass::kCode && TokenizeCodeLine(line, last_tag, inst)) {
+          scans++;
+          for (auto& arg : inst.args) {
+            if (state.fold) {
+              FoldArithSeries(arg, state.constants, true);
+            }
+          }
+          state.stream->OnInstruction(inst);
+        }
         break;
     }
-  }
+    return true;
+  });
+  end_block();
 
-  return a2;
+  constexpr ECounter kLines[] = {ECounter::kConstantLines, ECounter::kTableLines, ECounter::kCodeLines};
+  A2_COUNT(kLines[static_cast<std::size_t>(pass)], lines);
+  A2_COUNT(ECounter::kScans, scans);
 }
 
-void DumpConstants(const std::unordered_map<std::string, std::unique_ptr<ConstantsData>>& map, int indent) {
-  std::string indent_s(indent * 2, ' ');
+// An entry on its way through the pipeline. An error travels in place of the entry that caused
+// it, so the last stage reports the first error in source order, as a sequential stream would.
+struct StreamItem {
+  enum class EKind : std::uint8_t { kEntry, kCodeBlock, kInstruction, kError };
 
-  for (auto& pair : map) {
-    std::cout << indent_s << pair.first << ": 0x" << std::hex << pair.second->value << std::endl;
+  EKind kind = EKind::kEntry;
+  NamedRef entry;
+  Symbol code_block;
+  Instruction inst;
+  std::exception_ptr error;
+};
 
-    for (auto& bit_info : pair.second->bits_info) {
-      std::cout << indent_s << "  ." << bit_info.name << ": 0x" << bit_info.size << std::endl;
+// items cross a queue in batches, a queue operation per item would cost more than folding it
+using StreamBatch = std::vector<StreamItem>;
+constexpr std::size_t kStreamBatch = 256;
+constexpr std::size_t kStreamQueue = 8;
+
+// thrown into the tokenizer when a later stage stopped, unwinds StreamFile
+struct StreamStopped {};
+
+// the tokenizer stage's end of the first queue
+class BatchingStream : public ProgramStream {
+public:
+  explicit BatchingStream(SpscQueue<StreamBatch>& queue) : queue_(queue) {}
+
+  void OnConstants(const ConstantsTable&) override {}
+  void OnTableEntry(const NamedRef& entry) override { Add(StreamItem::EKind::kEntry).entry = entry; }
+  void OnCodeBlock(Symbol name) override { Add(StreamItem::EKind::kCodeBlock).code_block = name; }
+  void OnInstruction(const Instruction& inst) override { Add(StreamItem::EKind::kInstruction).inst = inst; }
+  void OnError(std::exception_ptr error) { Add(StreamItem::EKind::kError).error = error; }
+
+  void Flush() {
+    items_ += batch_.size();
+    if (!batch_.empty() && !queue_.Push(std::move(batch_))) {
+      throw StreamStopped();
     }
+    batch_.clear();
+    batch_.reserve(kStreamBatch);
+  }
 
-    DumpConstants(pair.second->children, indent + 1);
+  std::size_t Items() const { return items_; }
 
-    if (indent == 0) {
-      std::cout << std::endl;
+private:
+  StreamItem& Add(StreamItem::EKind kind) {
+    if (batch_.size() == kStreamBatch) {
+      Flush();
     }
+    batch_.emplace_back();
+    batch_.back().kind = kind;
+    return batch_.back();
   }
+
+  SpscQueue<StreamBatch>& queue_;
+  StreamBatch batch_;
+  std::size_t items_ = 0;
+};
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
-std::string RefedToStr(const Refed& refed) {
-  auto op = gRefedOpToChar[refed.op];
-  std::string s = op + std::string(op.length(), ' ');
+// Tokenizer thread -> fold thread -> the caller, which hands entries to the stream. Constants are
+// frozen by now, so the fold thread only reads them.
+void StreamPipelined(const SourceBuffer& source, const std::filesystem::path& dir, StreamState& state,
+    ProgramStream& stream, StreamStats* stats) {
+  SpscQueue<StreamBatch> tokens(kStreamQueue);
+  SpscQueue<StreamBatch> folded(kStreamQueue);
+  StreamStats local;
+  auto& st = stats != nullptr ? *stats : local;
 
-  switch (refed.type) {
-    case ERefedType::kNum:
-      s += ToHexStr(refed.num, true);
-      break;
-    case ERefedType::kAddr:
-      s += "@" + refed.ref;
-      break;
-    case ERefedType::kConst:
-      s += refed.ref;
-      break;
-    default:
-      break;
+  std::thread tokenizer([&]() {
+    auto start = std::chrono::steady_clock::now();
+    BatchingStream batching(tokens);
+    state.stream = &batching;
+    state.fold = false;
+    try {
+      try {
+        StreamFile(source, dir, EStreamPass::kTable, state);
+        StreamFile(source, dir, EStreamPass::kCode, state);
+      } catch (const StreamStopped&) {
+        throw;
+      } catch (...) {
+        batching.OnError(std::current_exception());
+      }
+      batching.Flush();
+    } catch (const StreamStopped&) {}
+    tokens.Close();
+    st.tokenize = {batching.Items(), SecondsSince(start)};
+  });
+
+  std::thread folder([&]() {
+    auto start = std::chrono::steady_clock::now();
+    std::size_t items = 0;
+    bool failed = false;
+    StreamBatch batch;
+    while (!failed && tokens.Pop(batch)) {
+      for (std::size_t i = 0; i < batch.size() && !failed; i++) {
+        auto& item = batch[i];
+        try {
+          if (item.kind == StreamItem::EKind::kEntry) {
+            FoldArithSeries(item.entry.value, state.constants, false);
+          } else if (item.kind == StreamItem::EKind::kInstruction) {
+            for (auto& arg : item.inst.args) {
+              FoldArithSeries(arg, state.constants, true);
+            }
+          }
+        } catch (...) {
+          item.kind = StreamItem::EKind::kError;
+          item.error = std::current_exception();
+        }
+        if (item.kind == StreamItem::EKind::kError) {
+          failed = true;
+          batch.resize(i + 1);
+        }
+        items++;
+      }
+      if (!folded.Push(std::move(batch))) {
+        break;
+      }
+    }
+    tokens.Close();
+    folded.Close();
+    st.fold = {items, SecondsSince(start)};
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  std::size_t items = 0;
+  std::exception_ptr error;
+  try {
+    StreamBatch batch;
+    while (folded.Pop(batch)) {
+      for (auto& item : batch) {
+        switch (item.kind) {
+          case StreamItem::EKind::kEntry:
+            stream.OnTableEntry(item.entry);
+            break;
+          case StreamItem::EKind::kCodeBlock:
+            stream.OnCodeBlock(item.code_block);
+            break;
+          case StreamItem::EKind::kInstruction:
+            stream.OnInstruction(item.inst);
+            break;
+          case StreamItem::EKind::kError:
+            std::rethrow_exception(item.error);
+        }
+        items++;
+      }
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  folded.Close();
+  tokenizer.join();
+  folder.join();
+  st.emit = {items, SecondsSince(start)};
+  st.tokens = tokens.GetStats();
+  st.folded = folded.GetStats();
+
+  // stall time is not work
+  st.tokenize.seconds -= st.tokens.full_seconds;
+  st.fold.seconds -= st.tokens.empty_seconds + st.folded.full_seconds;
+  st.emit.seconds -= st.folded.empty_seconds;
+
+  if (error) {
+    std::rethrow_exception(error);
   }
+}
+
+void StreamA2(std::unique_ptr<SourceBuffer> source, ProgramStream& stream, const StreamOptions& options, StreamStats* stats) {
+  std::error_code error;
+  StreamState state;
+  state.stream = &stream;
+  state.window = options.window;
+  state.paths.push_back(std::filesystem::weakly_canonical(source->Path(), error).string());
+  auto dir = std::filesystem::path(source->Path()).parent_path();
+
+  StreamFile(*source.get(), dir, EStreamPass::kConstants, state);
+  state.constants.Freeze();
+  stream.OnConstants(state.constants);
+
+  if (options.pipelined) {
+    StreamPipelined(*source.get(), dir, state, stream, stats);
+    return;
+  }
+  StreamFile(*source.get(), dir, EStreamPass::kTable, state);
+  StreamFile(*source.get(), dir, EStreamPass::kCode, state);
+}
+
+void DumpStreamStats(const StreamStats& stats) {
+  auto stage = [](const char* name, const StreamStats::Stage& stage) {
+    std::cout << std::dec << name << ": " << stage.items << " items, " << stage.seconds * 1000 << " ms busy";
+    if (stage.seconds > 0) {
+      std::cout << ", " << static_cast<std::size_t>(stage.items / stage.seconds) << " items/s";
+    }
+    std::cout << std::endl;
+  };
+  auto queue = [](const char* name, const QueueStats& queue) {
+    std::cout << std::dec << name << ": " << queue.items << " batches, " << queue.full_stalls << " full stalls ("
+      << queue.full_seconds * 1000 << " ms), " << queue.empty_stalls << " empty stalls (" << queue.empty_seconds * 1000
+      << " ms)" << std::endl;
+  };
+  std::cout << std::endl;
+  stage("tokenize", stats.tokenize);
+  queue("  queue", stats.tokens);
+  stage("fold", stats.fold);
+  queue("  queue", stats.folded);
+  stage("emit", stats.emit);
+}
+
+}
+
+namespace a2test {
 
+using namespace a2;
+
+namespace {
+
+std::string ArithSeriesToStr(const ArithSeries& series) {
+  std::string s;
+  AppendArithSeries(s, series);
   return s;
 }
 
-std::string ArithSeriesToStr(const std::vector<Refed>& arith_series) {
-  return std::accumulate(arith_series.begin(), arith_series.end(), std::string(), 
-    [](auto& ac, auto& refed) { 
-      return ac + (ac.empty() ? "" : " ") + RefedToStr(refed);
-  });
+std::string ArithSeriesArgsToStr(const InstructionArgs& args) {
+  std::string s;
+  AppendArgs(s, args);
+  return s;
 }
 
-std::string ArithSeriesArgsToStr(const std::vector<std::vector<Refed>>& args) {
-  return std::accumulate(args.begin(), args.end(), std::string(), 
-    [](auto& ac, auto& arith_series) { 
-      return ac + (ac.empty() ? "" : ", ") + ArithSeriesToStr(arith_series);
-  });
 }
 
-void DumpTable(const std::vector<NamedRef>& table) {
-  std::cout << std::endl << "table:" << std::endl;
+// parses a program with a few constants, the code is either a table entry or an instruction
+void TestFc(int id, const std::string& code, EParseErrorCode exp_error, const std::string& exp_folded) {
+  std::stringstream ss;
+  PutTestId(id, ss);
 
-  for (auto& entry : table) {
-    std::cout << "  " << entry.name << ": " << ArithSeriesToStr(entry.value) << std::endl;
+  std::stringstream src;
+  src << "_c:\n  a: 0x10\n  b: 4\n  n: 1\n    m: 2\n";
+  src << (code.find('(') == std::string::npos ? "#table:\n  t: " : "code:\n  ") << code << "\n";
+
+  bool pass = false;
+  try {
+    auto a2 = ParseA2(src);
+    auto folded = a2->table.empty() ? ArithSeriesArgsToStr(a2->instructions[0].args) : ArithSeriesToStr(a2->table[0].value);
+    if (exp_error == EParseErrorCode::kSuccess) {
+      pass = AssertEqual("folded", exp_folded, folded, ss);
+    } else {
+      ExceptionNotThrown(gEParseErrorCodeToStr[exp_error], ss);
+    }
+  } catch (const ParseException& pe) {
+    pass = AssertEqual("exception", gEParseErrorCodeToStr[exp_error], gEParseErrorCodeToStr[pe.Code], ss);
+  } catch (...) { UnexpectedException(ss); }
+
+  if (pass) { std::cout << "."; }
+  else { std::cout << std::endl << ss.str(); }
+}
+
+void ConstantsToStr(const ConstantsTable& constants, std::uint32_t node, std::ostream& out) {
+  auto& data = constants.Node(node);
+  out << data.name << "=" << data.value << "[";
+  for (auto b = data.bits_begin; b < data.bits_end; b++) {
+    out << constants.BitsInfos()[b].name << "=" << constants.BitsInfos()[b].size << " ";
   }
+  for (auto i = data.first_child; i != ConstantsData::kNone; i = constants.Node(i).next_sibling) {
+    ConstantsToStr(constants, i, out);
+  }
+  out << "]";
 }
 
-void DumpInstructions(const std::vector<Instruction>& insts) {
-  std::cout << std::endl << "instructions:" << std::endl;
+// everything a parse produces, in source order
+std::string ParsedToStr(const A2& a2) {
+  std::stringstream ss;
+  for (auto root : a2.constants.Roots()) {
+    ConstantsToStr(a2.constants, root, ss);
+  }
+  for (auto& entry : a2.table) {
+    ss << entry.name << ": " << ArithSeriesToStr(entry.value) << ";";
+  }
+  for (auto& block : a2.code_blocks) {
+    ss << block.name << "@" << block.begin << ";";
+  }
+  for (auto& inst : a2.instructions) {
+    ss << inst.tag << " " << inst.func << "(" << ArithSeriesArgsToStr(inst.args) << ");";
+  }
+  return ss.str();
+}
+
+// block-parallel parses match the sequential one, errors come from the first failing block
+void TestParallelParse(int id, const std::string& src, EParseErrorCode exp_error) {
+  std::stringstream ss;
+  PutTestId(id, ss);
+
+  std::string expected;
+  EParseErrorCode expected_error = EParseErrorCode::kSuccess;
+  try {
+    std::stringstream in(src);
+    expected = ParsedToStr(*ParseA2(SourceBuffer::Read(in)));
+  } catch (const ParseException& pe) { expected_error = pe.Code; }
+
+  bool pass = AssertEqual("sequential exception", gEParseErrorCodeToStr[exp_error], gEParseErrorCodeToStr[expected_error], ss);
+  ThreadPool pool(4);
+  for (int round = 0; round < 4 && pass; round++) {
+    std::string actual;
+    EParseErrorCode actual_error = EParseErrorCode::kSuccess;
+    try {
+      std::stringstream in(src);
+      actual = ParsedToStr(*ParseA2(SourceBuffer::Read(in), &pool));
+    } catch (const ParseException& pe) { actual_error = pe.Code; }
+    pass = AssertEqual("exception", gEParseErrorCodeToStr[expected_error], gEParseErrorCodeToStr[actual_error], ss) &&
+           AssertEqual("parsed", expected, actual, ss);
+  }
+
+  if (pass) { std::cout << "."; }
+  else { std::cout << std::endl << ss.str(); }
+}
+
+void WriteFile(const std::filesystem::path& path, const std::string& text) {
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream(path, std::ios::binary) << text;
+}
+
+// parses dir/main.a2, returns the folded first instruction arguments or the error code name
+std::string ParseIncluding(const std::filesystem::path& dir) {
+  try {
+    auto a2 = ParseA2(SourceBuffer::Map((dir / "main.a2").string()));
+    return ArithSeriesArgsToStr(a2->instructions.at(0).args);
+  } catch (const ParseException& pe) {
+    return gEParseErrorCodeToStr[pe.Code];
+  }
+}
+
+void TestIncludeCase(int id, const std::filesystem::path& dir, const std::string& expected, std::size_t exp_misses) {
+  std::stringstream ss;
+  PutTestId(id, ss);
+
+  auto before = ModuleCache::Global().GetStats().misses;
+  auto actual = ParseIncluding(dir);
+  if (AssertEqual("result", expected, actual, ss) &&
+      AssertEqual("cache misses", exp_misses, ModuleCache::Global().GetStats().misses - before, ss)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss.str();
+  }
+}
 
-  for (auto& inst : insts) {
-    if (!inst.tag.empty()) {
-      std::cout << "  " << inst.tag << std::endl;
+void TestInclude() {
+  PutTestHeader("Include", std::cout);
+
+  auto dir = std::filesystem::temp_directory_path() / "a2test_include";
+  std::filesystem::remove_all(dir);
+  auto code = "code:\n  MOVS(r0, a + sub.b)\n";
+
+  WriteFile(dir / "dev.a2", "!include sub/regs.a2\n_dev:\n  a: 0x10\n");
+  WriteFile(dir / "sub" / "regs.a2", "_regs:\n  sub:  0\n    b: 2\n");
+  WriteFile(dir / "main.a2", std::string("!include dev.a2\n") + code);
+  TestIncludeCase(1, dir, "r0, 0x12", 2);
+  TestIncludeCase(2, dir, "r0, 0x12", 0);                    // both files come from the cache
+
+  WriteFile(dir / "sub" / "regs.a2", "_regs:\n  sub:  0\n    b: 3\n");
+  TestIncludeCase(3, dir, "r0, 0x13", 1);                    // only the changed file is parsed again
+
+  WriteFile(dir / "main.a2", std::string("!include missing.a2\n") + code);
+  TestIncludeCase(4, dir, "kIncludeNotFound", 0);
+
+  WriteFile(dir / "main.a2", std::string("!include dev.a2\n") + code);
+  WriteFile(dir / "sub" / "regs.a2", "!include ../dev.a2\n");
+  TestIncludeCase(5, dir, "kIncludeCycle", 1);          // dev.a2 is cached, the new regs.a2 is not
+
+  WriteFile(dir / "main.a2", std::string("!include main.a2\n") + code);
+  TestIncludeCase(6, dir, "kIncludeCycle", 0);
+
+  WriteFile(dir / "main.a2", std::string("!includes dev.a2\n") + code);
+  TestIncludeCase(7, dir, "kUnexpected", 0);
+
+  // code of an include lands between the code blocks around it
+  {
+    std::stringstream ss;
+    PutTestId(8, ss);
+    WriteFile(dir / "lib.a2", "lib:\n  MOVS(r0, 2)\n");
+    WriteFile(dir / "main.a2", "first:\n  loop:\n  MOVS(r0, 1)\n  BNE(loop)\n!include lib.a2\nlast:\n  MOVS(r0, 3)\n");
+    std::string parsed;
+    try {
+      parsed = ParsedToStr(*ParseA2(SourceBuffer::Map((dir / "main.a2").string())).get());
+    } catch (...) { UnexpectedException(ss); }
+
+    if (AssertEqual("parsed", std::string("first@0;lib@2;last@3;loop MOVS(r0, 0x1); BNE(@loop); MOVS(r0, 0x2); MOVS(r0, 0x3);"),
+        parsed, ss)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss.str();
     }
-    std::cout << "    " << inst.func << ": " << ArithSeriesArgsToStr(inst.args) << std::endl;
   }
+
+  std::filesystem::remove_all(dir);
+  std::cout << std::endl;
 }
 
-void DumpA2(const A2& a2) {
-  DumpConstants(a2.constants, 0);
-  DumpTable(a2.table);
-  DumpInstructions(a2.instructions);
+void TestParser() {
+  PutTestHeader("FoldConstants", std::cout);
+  TestFc(1, "a + b", EParseErrorCode::kSuccess, "0x14");
+  TestFc(2, "a - b + 1", EParseErrorCode::kSuccess, "0xd");
+  TestFc(3, "n.m + 0x100", EParseErrorCode::kSuccess, "0x102");
+  TestFc(4, "@reset + 1", EParseErrorCode::kSuccess, "@reset + 0x1");
+  TestFc(5, "@reset", EParseErrorCode::kSuccess, "@reset");
+  TestFc(6, "a - @x + b", EParseErrorCode::kSuccess, "- @x + 0x14");
+  TestFc(7, "@x - a + a", EParseErrorCode::kSuccess, "@x");
+
+  TestFc(10, "c", EParseErrorCode::kUnknownConstant, "");
+  TestFc(11, "n.q", EParseErrorCode::kUnknownConstant, "");
+
+  TestFc(20, "B(loop)", EParseErrorCode::kSuccess, "@loop");
+  TestFc(21, "STR(n.m, @int + a)", EParseErrorCode::kSuccess, "0x2, @int + 0x10");
+  TestFc(22, "B(n.q)", EParseErrorCode::kUnknownConstant, "");
+  std::cout << std::endl;
+
+  PutTestHeader("ParallelParse", std::cout);
+  std::stringstream src;
+  for (int i = 0; i < 40; i++) {
+    src << "_c" << i % 3 << ":\n  a" << i << ": " << i << "\n    b: 2\n      .x: 1\n  n" << i << ": 4\n";
+    src << "#table:\n  t" << i << ": a" << i << ".b + @f" << i << "\n";
+    src << "f" << i << ":\n  l:\n    MOVS(r0, n" << i << ")\n    B(l)\n";
+  }
+  TestParallelParse(1, src.str(), EParseErrorCode::kSuccess);
+  TestParallelParse(2, src.str() + "bad:\n   NOP\n#table:\n  t: 1 2\n", EParseErrorCode::kIndentCount);
+  TestParallelParse(3, src.str() + "bad:\n  B(a0.q)\n", EParseErrorCode::kUnknownConstant);
+  std::cout << std::endl;
+
+  TestInclude();
 }
 
 }
@@ -5,11 +5,77 @@
 #include <string>
 
 #include "types.h"
+#include "module.h"
+#include "source.h"
+#include "spscqueue.h"
+#include "threadpool.h"
 
 namespace a2 {
 
 std::unique_ptr<A2> ParseA2(std::istream& from);
 
-void DumpA2(const A2& a2); 
+// parses directly out of the buffer, typically a memory-mapped file (see SourceBuffer::Map);
+// the buffer is released once parsing is done, names live on in the symbol table.
+// With a pool, blocks are tokenized concurrently and merged in source order, so the result
+// (and the error thrown, if any) is the same as a sequential parse. Included files are looked up
+// in and added to modules, ModuleCache::Global() if none is given. Files are told apart by
+// canonical path: one included again (say by two includes that share it) is merged only the
+// first time, an include of a file that is still being merged is kIncludeCycle.
+std::unique_ptr<A2> ParseA2(std::unique_ptr<SourceBuffer> source, ThreadPool* pool = nullptr,
+    ModuleCache* modules = nullptr);
 
+// Receives a program from StreamA2 one folded entry at a time.
+class ProgramStream {
+public:
+  virtual ~ProgramStream() = default;
+
+  // all constants blocks are merged and frozen before any entry arrives
+  virtual void OnConstants(const ConstantsTable& constants) = 0;
+  virtual void OnTableEntry(const NamedRef& entry) = 0;
+
+  // a code block starts, its name refers to the first instruction that follows
+  virtual void OnCodeBlock(Symbol name) = 0;
+  virtual void OnInstruction(const Instruction& inst) = 0;
+};
+
+constexpr std::size_t kStreamWindow = 1 << 20;
+
+struct StreamOptions {
+  std::size_t window = kStreamWindow;     // bytes of text line-indexed at a time
+  bool pipelined = false;                 // tokenize, fold and hand over entries on three threads
+};
+
+// of a pipelined stream: entries through each stage, with the time spent working (stalls excluded)
+// and how often each stage waited on its neighbours
+struct StreamStats {
+  struct Stage {
+    std::size_t items = 0;
+    double seconds = 0;
+  };
+
+  Stage tokenize;
+  Stage fold;
+  Stage emit;           // the ProgramStream, e.g. encoding and writing the image
+  QueueStats tokens;    // tokenize -> fold
+  QueueStats folded;    // fold -> emit
+};
+
+// Parses without building an A2, so memory does not grow with the source: files are read three
+// times (constants, table, code) in windows of whole lines and only the constants are kept.
+// Entries arrive in the order ParseA2 stores them; of several errors, one may be reported that
+// a sequential ParseA2 would only have reached later. Pipelined, the stream is still called on
+// the calling thread only, and stats (if given) are filled in.
+void StreamA2(std::unique_ptr<SourceBuffer> source, ProgramStream& stream, const StreamOptions& options = {},
+    StreamStats* stats = nullptr);
+
+// Resolves every constant in table entries and instruction arguments once constants are frozen,
+// leaving only @address terms for the linker (ParseA2 does this already).
+void FoldConstants(A2& a2, ThreadPool* pool = nullptr);
+
+void DumpStreamStats(const StreamStats& stats);
+
+}
+
+namespace a2test {
+void TestParser();
 }
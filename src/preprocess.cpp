@@ -0,0 +1,186 @@
+#include "preprocess.h"
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "types.h"
+#include "testutil.h"
+
+namespace {
+
+constexpr std::size_t kChunk = 32;
+constexpr std::size_t kNoPos = ~std::size_t(0);
+
+struct ChunkMasks {
+  std::uint32_t newline;
+  std::uint32_t non_blank;
+  std::uint32_t tab;
+};
+
+ChunkMasks Classify(const char* p) {
+#if defined(__AVX2__)
+  __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  auto eq = [&v](char c) {
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+  };
+#elif defined(__SSE2__)
+  __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+  auto eq = [&lo, &hi](char c) {
+    __m128i cv = _mm_set1_epi8(c);
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(lo, cv))) |
+      (static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(hi, cv))) << 16);
+  };
+#else
+  auto eq = [p](char c) {
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; i < kChunk; i++) {
+      mask |= static_cast<std::uint32_t>(p[i] == c) << i;
+    }
+    return mask;
+  };
+#endif
+
+  auto newline = eq('\n');
+  auto tab = eq('\t');
+  return { newline, ~(newline | tab | eq(' ') | eq('\r')), tab };
+}
+
+// bits [from, to) of a chunk mask
+std::uint32_t MaskRange(unsigned from, unsigned to) {
+  return static_cast<std::uint32_t>(((std::uint64_t(1) << to) - 1) & ~((std::uint64_t(1) << from) - 1));
+}
+
+// m is not 0
+#ifdef _MSC_VER
+unsigned LowestBit(std::uint32_t m) { unsigned long i; _BitScanForward(&i, m); return i; }
+unsigned HighestBit(std::uint32_t m) { unsigned long i; _BitScanReverse(&i, m); return i; }
+#else
+unsigned LowestBit(std::uint32_t m) { return __builtin_ctz(m); }
+unsigned HighestBit(std::uint32_t m) { return 31 - __builtin_clz(m); }
+#endif
+
+}
+
+namespace a2 {
+
+LineIndex::LineIndex(std::string_view text) {
+  std::size_t line_start = 0;
+  std::size_t first = kNoPos;     // first and last non-blank of the current line
+  std::size_t last = kNoPos;
+  bool has_tab = false;
+  std::vector<Rewritten> rewritten_lines;
+
+  char tail[kChunk];
+  for (std::size_t base = 0; base < text.length(); base += kChunk) {
+    const char* p = text.data() + base;
+    if (base + kChunk > text.length()) {
+      std::memset(tail, ' ', kChunk);
+      std::memcpy(tail, p, text.length() - base);
+      p = tail;
+    }
+
+    auto masks = Classify(p);
+    unsigned pos = 0;
+    auto newline = masks.newline;
+    while (true) {
+      unsigned end = newline != 0 ? LowestBit(newline) : kChunk;
+      auto segment = MaskRange(pos, end);
+      auto non_blank = masks.non_blank & segment;
+      if (non_blank != 0) {
+        if (first == kNoPos) { first = base + LowestBit(non_blank); }
+        last = base + HighestBit(non_blank);
+      }
+      has_tab = has_tab || (masks.tab & segment) != 0;
+
+      if (newline == 0) { break; }
+
+      AddLine(text, line_start, first, last, has_tab, rewritten_lines);
+      line_start = base + end + 1;
+      first = last = kNoPos;
+      has_tab = false;
+      pos = end + 1;
+      newline &= newline - 1;
+    }
+  }
+  AddLine(text, line_start, first, last, has_tab, rewritten_lines);
+
+  for (auto& r : rewritten_lines) {       // storage is final now, turn offsets into views
+    lines_[r.line].text = std::string_view(rewritten_.data() + r.offset, r.length);
+  }
+}
+
+void LineIndex::AddLine(std::string_view text, std::size_t start, std::size_t first, std::size_t last, bool has_tab,
+    std::vector<Rewritten>& rewritten_lines) {
+  if (first == kNoPos) { return; }          // blank line
+  if (text[first] == '\'') { return; }      // comment starts with sigle quote, check first non-blank character
+
+  if (!has_tab) {
+    lines_.push_back({text.substr(start, last + 1 - start), first - start});
+    return;
+  }
+
+  std::size_t indent = 0;
+  for (auto i = start; i < first; i++) {
+    indent += text[i] == '\t' ? INDENT_UNIT : 1;
+  }
+
+  auto offset = rewritten_.size();
+  rewritten_.insert(rewritten_.end(), indent, ' ');
+  for (auto i = first; i <= last; i++) {
+    rewritten_.push_back(text[i] == '\t' ? ' ' : text[i]);
+  }
+
+  rewritten_lines.push_back({lines_.size(), offset, rewritten_.size() - offset});
+  lines_.push_back({{}, indent});
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestLi(int id, const std::string& text, const std::vector<std::string_view>& exp_lines, const std::vector<std::size_t>& exp_indents) {
+  std::stringstream ss;
+  PutTestId(id, ss);
+
+  LineIndex index(text);
+  std::vector<std::string_view> lines;
+  std::vector<std::size_t> indents;
+  for (auto& line : index.Lines()) {
+    lines.push_back(line.text);
+    indents.push_back(line.indent);
+  }
+
+  if (AssertEqual("lines", exp_lines, lines, ss) && AssertEqual("indents", exp_indents, indents, ss)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss.str();
+  }
+}
+
+void TestPreprocess() {
+  PutTestHeader("LineIndex", std::cout);
+  TestLi(1, "", {}, {});
+  TestLi(2, "a:", {"a:"}, {0});
+  TestLi(3, "a:\n  NOP\n", {"a:", "  NOP"}, {0, 2});
+  TestLi(4, "a:  \n\n   \n  ' comment\n  NOP  ", {"a:", "  NOP"}, {0, 2});
+  TestLi(5, "a:\r\n  NOP\r\n", {"a:", "  NOP"}, {0, 2});
+  TestLi(6, "a:\n\tNOP\n\t\tB(x,\t1)\t\n", {"a:", "  NOP", "    B(x, 1)"}, {0, 2, 4});
+  std::string wide_indent = std::string(40, ' ') + "x";    // lines crossing 32-byte chunks
+  std::string wide_line(33, 'y');
+  TestLi(7, wide_indent + "\n" + std::string(31, ' ') + "\n" + wide_line, {wide_indent, wide_line}, {40, 0});
+  TestLi(8, "\t'\tcomment\n\t.a: 1", {"  .a: 1"}, {2});
+  std::cout << std::endl;
+}
+
+}
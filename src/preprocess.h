@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+namespace a2 {
+
+struct SourceLine {
+  std::string_view text;     // trailing blanks removed, leading spaces kept
+  std::size_t indent = 0;    // number of leading spaces
+};
+
+// Splits the text into the lines the parser consumes. Blank and comment (') lines are dropped,
+// trailing blanks (' ', '\t', '\r') are removed, and lines holding tabs are rewritten with spaces:
+// a tab in the indent counts as one indent level, any other tab as a single space.
+// Line boundaries and blanks are classified 32 bytes at a time (AVX2, SSE2 or scalar).
+class LineIndex {
+public:
+  LineIndex() = default;
+  explicit LineIndex(std::string_view text);
+
+  const std::vector<SourceLine>& Lines() const { return lines_; }
+
+private:
+  struct Rewritten {
+    std::size_t line;
+    std::size_t offset;
+    std::size_t length;
+  };
+
+  void AddLine(std::string_view text, std::size_t start, std::size_t first, std::size_t last, bool has_tab,
+      std::vector<Rewritten>& rewritten_lines);
+
+  std::vector<SourceLine> lines_;
+  std::vector<char> rewritten_;    // storage for lines that had tabs, keeps its address when moved
+};
+
+}
+
+namespace a2test {
+void TestPreprocess();
+}
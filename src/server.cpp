@@ -0,0 +1,427 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "exception.h"
+#include "symbol.h"
+#include "testutil.h"
+
+namespace {
+
+using namespace a2;
+
+std::vector<std::string> SplitFields(const std::string& line) {
+  std::vector<std::string> fields;
+  std::size_t begin = 0;
+  for (auto tab = line.find('\t'); tab != std::string::npos; tab = line.find('\t', begin)) {
+    fields.push_back(line.substr(begin, tab - begin));
+    begin = tab + 1;
+  }
+  fields.push_back(line.substr(begin));
+  return fields;
+}
+
+bool IsStop(const std::vector<std::string>& fields) {
+  return fields[0] == "stop";
+}
+
+int Log2(std::uint32_t n) {
+  int log = 0;
+  while (n >>= 1) {
+    log++;
+  }
+  return log;
+}
+
+std::size_t LatencyBucket(std::uint32_t us) {
+  if (us < 8) {
+    return us;
+  }
+  auto log = Log2(us);
+  return 8 + static_cast<std::size_t>(log - 3) * 4 + ((us >> (log - 2)) & 3);
+}
+
+// the largest latency that falls into bucket
+std::uint64_t LatencyBucketEnd(std::size_t bucket) {
+  if (bucket < 8) {
+    return bucket;
+  }
+  auto log = (bucket - 8) / 4 + 3;
+  auto quarter = (bucket - 8) % 4;
+  return ((4 + quarter + 1) << (log - 2)) - 1;
+}
+
+#ifndef _WIN32
+
+bool WriteAll(int fd, const std::string& text) {
+  for (std::size_t done = 0; done < text.size();) {
+    auto n = write(fd, text.data() + done, text.size() - done);
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+// Buffered reads of one connection. Returns false at the end of the stream or on an error.
+class LineReader {
+public:
+  explicit LineReader(int fd) : fd_(fd) {}
+
+  bool ReadLine(std::string& line) {
+    for (;;) {
+      auto eol = buffer_.find('\n');
+      if (eol != std::string::npos) {
+        line = buffer_.substr(0, eol);
+        buffer_.erase(0, eol + 1);
+        return true;
+      }
+      char chunk[4096];
+      auto n = read(fd_, chunk, sizeof(chunk));
+      if (n <= 0) {
+        return false;
+      }
+      buffer_.append(chunk, static_cast<std::size_t>(n));
+    }
+  }
+
+private:
+  int fd_;
+  std::string buffer_;
+};
+
+bool MakeAddress(const std::string& path, sockaddr_un& address) {
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+// Frees path for bind when a server that did not stop cleanly left its socket there. False if
+// path is taken: by a socket a server still listens on, or by anything that is not a socket.
+bool ClaimSocketPath(const std::string& path, const sockaddr_un& address) {
+  struct stat info;
+  if (lstat(path.c_str(), &info) != 0) {
+    return errno == ENOENT;
+  }
+  if (!S_ISSOCK(info.st_mode)) {
+    return false;
+  }
+  int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe < 0) {
+    return false;
+  }
+  bool live = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+  close(probe);
+  return !live && unlink(path.c_str()) == 0;
+}
+
+#endif
+
+}
+
+namespace a2 {
+
+Server::Server(Context& context, const std::string& socket_path) : context_(context), socket_path_(socket_path) {}
+
+Server::~Server() {
+#ifndef _WIN32
+  if (listener_ >= 0) {
+    close(listener_);
+  }
+#endif
+}
+
+std::string Server::Handle(const std::string& request) {
+  auto fields = SplitFields(request);
+  if (fields[0] == "stats") {
+    return "ok\n" + Stats();
+  } else if (IsStop(fields)) {
+    return "ok\n";
+  } else if (fields[0] != "assemble" || fields.size() != 4) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_++;
+    errors_++;
+    return "error bad request\n";
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::string response;
+  EImageFormat format;
+  if (!FindImageFormat(fields[1], format)) {
+    response = "error unknown image format\n";
+  } else {
+    try {
+      auto a2 = context_.Parse(fields[2]);
+      if (!a2) {
+        response = "error cannot find file\n";
+      } else {
+        auto image = context_.Assemble(*a2.get(), format);
+        std::ofstream out(fields[3], std::ios::binary);
+        if (!out.write(image.data(), static_cast<std::streamsize>(image.size()))) {
+          response = "error cannot write " + fields[3] + "\n";
+        } else {
+          response = std::to_string(image.size()) + " bytes ";
+        }
+      }
+    } catch (const ParseException& pe) {
+      response = "error " + std::string(gEParseErrorCodeToStr[pe.Code]) + "\n";
+    } catch (const std::exception& e) {
+      response = "error " + std::string(e.what()) + "\n";
+    }
+  }
+  auto us = static_cast<std::uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  requests_++;
+  RecordLatency(us);
+  if (response.rfind("error", 0) == 0) {
+    errors_++;
+    return response;
+  }
+  return "ok\n" + response + std::to_string(us) + " us\n";
+}
+
+// called with mutex_ held
+void Server::RecordLatency(std::uint32_t us) {
+  latency_buckets_[LatencyBucket(us)]++;
+  latencies_++;
+  max_latency_us_ = std::max(max_latency_us_, us);
+}
+
+std::string Server::Stats() const {
+  std::stringstream out;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the end of the bucket that holds the p-th percentile, at most the largest latency seen
+    auto percentile = [this](std::uint64_t p) -> std::uint64_t {
+      auto rank = (latencies_ * p + 99) / 100;
+      std::uint64_t seen = 0;
+      for (std::size_t b = 0; b < kLatencyBuckets; b++) {
+        seen += latency_buckets_[b];
+        if (seen >= rank && seen > 0) {
+          return std::min<std::uint64_t>(LatencyBucketEnd(b), max_latency_us_);
+        }
+      }
+      return 0;
+    };
+    out << "requests " << requests_ << ", errors " << errors_ << std::endl;
+    out << "latency us p50 " << percentile(50) << ", p90 " << percentile(90) << ", p99 " << percentile(99)
+        << ", max " << max_latency_us_ << std::endl;
+  }
+  auto cache = context_.CacheStats();
+  out << "includes " << cache.hits << " hits (" << cache.disk_hits << " from disk), " << cache.misses
+      << " misses, " << cache.parsed_bytes << " bytes parsed, " << cache.evictions << " evicted" << std::endl;
+  out << "symbols " << SymbolTable::Global().GetStats().distinct << " of " << SymbolTable::kMaxNames << std::endl;
+  return out.str();
+}
+
+#ifndef _WIN32
+
+bool Server::Run() {
+  sockaddr_un address;
+  if (!MakeAddress(socket_path_, address)) {
+    return false;
+  }
+  if (!ClaimSocketPath(socket_path_, address)) {
+    return false;
+  }
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    return false;
+  }
+  if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0) {
+    close(listener);
+    return false;
+  }
+  listener_ = listener;
+
+  bool failed = false;
+  while (!stopping_) {
+    int connection = accept(listener, nullptr, nullptr);
+    if (connection < 0) {
+      if (stopping_ || errno == EINTR || errno == ECONNABORTED) {
+        continue;      // the listener was shut down by a stop request, or a client went away
+      }
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));     // until connections close
+        continue;
+      }
+      failed = true;
+      break;
+    }
+    {
+      std::lock_guard<std::mutex> lock(connections_mutex_);
+      connections_.push_back(connection);
+    }
+    std::thread([this, connection] {
+      Serve(connection);
+      std::lock_guard<std::mutex> lock(connections_mutex_);      // notified under the lock, Run may return right after
+      connections_.erase(std::find(connections_.begin(), connections_.end(), connection));
+      close(connection);
+      connections_done_.notify_all();
+    }).detach();
+  }
+
+  {
+    // idle clients would otherwise keep their threads waiting for a request
+    std::unique_lock<std::mutex> lock(connections_mutex_);
+    for (auto fd : connections_) {
+      shutdown(fd, SHUT_RDWR);
+    }
+    connections_done_.wait(lock, [this] { return connections_.empty(); });
+  }
+  close(listener);
+  listener_ = -1;
+  unlink(socket_path_.c_str());
+  return !failed;
+}
+
+void Server::Serve(int connection) {
+  LineReader reader(connection);
+  std::string request;
+  while (!stopping_ && reader.ReadLine(request)) {
+    if (!WriteAll(connection, Handle(request) + "\n")) {
+      return;
+    }
+    if (IsStop(SplitFields(request))) {
+      stopping_ = true;
+      shutdown(listener_, SHUT_RDWR);     // wakes the accept in Run
+      return;
+    }
+  }
+}
+
+std::string ServerRequest(const std::string& socket_path, const std::string& request) {
+  sockaddr_un address;
+  if (!MakeAddress(socket_path, address)) {
+    return {};
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return {};
+  }
+  std::string response;
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 && WriteAll(fd, request + "\n")) {
+    LineReader reader(fd);
+    std::string line;
+    while (reader.ReadLine(line) && !line.empty()) {
+      response += line + "\n";
+    }
+  }
+  close(fd);
+  return response;
+}
+
+#else
+
+bool Server::Run() {
+  return false;
+}
+
+void Server::Serve(int) {}
+
+std::string ServerRequest(const std::string&, const std::string&) {
+  return {};
+}
+
+#endif
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestServer() {
+  PutTestHeader("Server", std::cout);
+
+  std::stringstream ss;
+  PutTestId(1, ss);
+#ifndef _WIN32
+  auto dir = std::filesystem::temp_directory_path() / "a2test_server";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "dev.a2", std::ios::binary) << "_dev:\n  a: 0x10\n";
+  std::ofstream(dir / "main.a2", std::ios::binary) << "!include dev.a2\ncode:\n  MOVS(r0, a)\n";
+  auto socket = (dir / "a2.sock").string();
+  auto request = "assemble\tbin\t" + (dir / "main.a2").string() + "\t" + (dir / "main.bin").string();
+
+  Context context;
+  Server server(context, socket);
+  bool ran = false;
+  std::thread serving([&] { ran = server.Run(); });
+
+  // the socket appears once the server listens
+  std::string first;
+  for (int retry = 0; retry < 200 && first.empty(); retry++) {
+    first = ServerRequest(socket, request);
+    if (first.empty()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+  auto second = ServerRequest(socket, request);
+  auto missing = ServerRequest(socket, "assemble\tbin\t" + (dir / "missing.a2").string() + "\t" + (dir / "x.bin").string());
+  auto stats = ServerRequest(socket, "stats");
+  Server other(context, socket);
+  bool other_ran = other.Run();                          // the path belongs to a live server
+  auto stop = ServerRequest(socket, "stop\tnow");          // extra fields stop it all the same
+  serving.join();
+
+  std::ifstream image_file(dir / "main.bin", std::ios::binary);
+  std::string image((std::istreambuf_iterator<char>(image_file)), std::istreambuf_iterator<char>());
+
+  if (AssertEqual("first", std::string("ok\n2 bytes"), first.substr(0, 10), ss) &&
+      AssertEqual("second", std::string("ok\n2 bytes"), second.substr(0, 10), ss) &&
+      AssertEqual("image", std::string("\x10\x20", 2), image, ss) &&
+      AssertEqual("missing", std::string("error cannot find file\n"), missing, ss) &&
+      AssertEqual("requests", true, stats.find("requests 3, errors 1\n") != std::string::npos, ss) &&
+      AssertEqual("includes", true, stats.find("includes 1 hits (0 from disk), 1 misses") != std::string::npos, ss) &&
+      AssertEqual("symbols", true, stats.find("symbols ") != std::string::npos, ss) &&
+      AssertEqual("stop", std::string("ok\n"), stop, ss) &&
+      AssertEqual("other ran", false, other_ran, ss) &&
+      AssertEqual("ran", true, ran, ss) &&
+      AssertEqual("socket removed", false, std::filesystem::exists(socket), ss)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss.str() << stats;
+  }
+
+  // a file that is not a socket is never replaced
+  std::stringstream ss2;
+  PutTestId(2, ss2);
+  std::ofstream(socket, std::ios::binary) << "keep";
+  Server blocked(context, socket);
+  if (AssertEqual("ran", false, blocked.Run(), ss2) &&
+      AssertEqual("file kept", true, std::filesystem::is_regular_file(socket), ss2)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss2.str();
+  }
+  std::filesystem::remove_all(dir);
+#else
+  std::cout << "..";
+#endif
+  std::cout << std::endl;
+}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "image.h"
+
+namespace a2 {
+
+// source text of included files a server keeps parsed, older revisions of edited files go first
+constexpr std::size_t kServerCacheBytes = 64 << 20;
+
+// Assembles on behalf of short-lived clients over a Unix domain socket, so included files stay
+// parsed in the server's Context between requests. Requests and responses are text: a request
+// is one line of tab-separated fields, a response is a status line ("ok" or "error <reason>"),
+// any number of lines, and an empty line. A connection may carry several requests.
+//
+//   assemble <bin|hex|elf> <input path> <image path>   ok, then "<bytes> bytes <us> us"
+//   stats                                              ok, then the ServerStats lines
+//   stop                                               ok, the server returns from Run
+//
+// Paths are used as given, so clients send absolute ones. Not available on Windows.
+//
+// The include cache is capped (kServerCacheBytes), but names go into the process-wide symbol
+// table, which only grows: once SymbolTable::kMaxNames distinct names have been seen, requests
+// that bring new names fail with "error kTooManyNames" and the server has to be restarted.
+// Stats reports how full the table is.
+class Server {
+public:
+  Server(Context& context, const std::string& socket_path);
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  // Binds the socket and serves each connection on its own thread until a stop request. A socket
+  // left at the path by a server that is gone is replaced; returns false if the path is taken
+  // (a live server, or a file that is not a socket), cannot be bound, or accepting fails for
+  // good. Running out of descriptors only pauses accepting until connections close.
+  bool Run();
+
+  // request count, errors, latency percentiles and the context's include cache
+  std::string Stats() const;
+
+private:
+  void Serve(int connection);
+  std::string Handle(const std::string& request);
+  void RecordLatency(std::uint32_t us);
+
+  Context& context_;
+  std::string socket_path_;
+  std::atomic<int> listener_{-1};
+  std::atomic<bool> stopping_{false};
+
+  // connections being served, each on a detached thread that removes and closes its own
+  std::mutex connections_mutex_;
+  std::condition_variable connections_done_;
+  std::vector<int> connections_;
+
+  mutable std::mutex mutex_;
+  std::size_t requests_ = 0;
+  std::size_t errors_ = 0;
+
+  // Latencies of assemble requests in a fixed histogram, so a long-running server keeps constant
+  // memory: one bucket per microsecond below 8, then 4 buckets per power of two (within 25%).
+  static constexpr std::size_t kLatencyBuckets = 8 + 29 * 4;
+  std::array<std::uint64_t, kLatencyBuckets> latency_buckets_{};
+  std::uint64_t latencies_ = 0;
+  std::uint32_t max_latency_us_ = 0;
+};
+
+// Sends one request and returns the response without its terminating empty line, or an empty
+// string if the server cannot be reached.
+std::string ServerRequest(const std::string& socket_path, const std::string& request);
+
+}
+
+namespace a2test {
+void TestServer();
+}
@@ -0,0 +1,90 @@
+#include "smallvector.h"
+
+#include <sstream>
+#include <string>
+
+#include "testutil.h"
+
+namespace a2test {
+
+using namespace a2;
+
+namespace {
+
+using Terms = SmallVector<std::string, 2>;
+
+std::string Join(const Terms& terms) {
+  std::string s;
+  for (auto& term : terms) {
+    s += term + ";";
+  }
+  return s;
+}
+
+void TestSv(bool pass, std::stringstream& ss) {
+  if (pass) { std::cout << "."; }
+  else { std::cout << std::endl << ss.str(); }
+}
+
+}
+
+void TestSmallVector() {
+  PutTestHeader("SmallVector", std::cout);
+
+  {
+    std::stringstream ss;
+    PutTestId(1, ss);
+    Terms terms{"a", "b"};
+    TestSv(AssertEqual("inline", true, terms.IsInline(), ss) && AssertEqual("terms", std::string("a;b;"), Join(terms), ss), ss);
+  }
+  {
+    std::stringstream ss;
+    PutTestId(2, ss);
+    Terms terms{"a", "b"};
+    terms.emplace_back(terms[0]);     // refers to an element while growing
+    terms.push_back("d");
+    TestSv(AssertEqual("inline", false, terms.IsInline(), ss) && AssertEqual("terms", std::string("a;b;a;d;"), Join(terms), ss), ss);
+  }
+  {
+    std::stringstream ss;
+    PutTestId(3, ss);
+    Terms small{"a"};
+    Terms large{"a", "b", "c"};
+    Terms small_moved(std::move(small));
+    Terms large_moved(std::move(large));
+    TestSv(AssertEqual("small", std::string("a;"), Join(small_moved), ss) &&
+           AssertEqual("large", std::string("a;b;c;"), Join(large_moved), ss) &&
+           AssertEqual("moved from", std::size_t(0), small.size() + large.size(), ss) &&
+           AssertEqual("moved from inline", true, small.IsInline() && large.IsInline(), ss), ss);
+  }
+  {
+    std::stringstream ss;
+    PutTestId(4, ss);
+    Terms large{"a", "b", "c"};
+    Terms copy(large);
+    Terms assigned{"x"};
+    assigned = copy;
+    copy.resize(1);
+    large.resize(4);
+    TestSv(AssertEqual("copy", std::string("a;"), Join(copy), ss) &&
+           AssertEqual("assigned", std::string("a;b;c;"), Join(assigned), ss) &&
+           AssertEqual("grown", std::string("a;b;c;;"), Join(large), ss), ss);
+  }
+  {
+    std::stringstream ss;
+    PutTestId(5, ss);
+    SmallVector<Terms, 1> args;
+    args.push_back({"a"});
+    args.push_back({"b", "c", "d"});   // moves both the outer and an inner vector to the heap
+    args.emplace_back();
+    args.back().push_back("e");
+    SmallVector<Terms, 1> moved(std::move(args));
+    TestSv(AssertEqual("args", std::size_t(3), moved.size(), ss) &&
+           AssertEqual("arg 0", std::string("a;"), Join(moved[0]), ss) &&
+           AssertEqual("arg 1", std::string("b;c;d;"), Join(moved[1]), ss) &&
+           AssertEqual("arg 2", std::string("e;"), Join(moved[2]), ss), ss);
+  }
+  std::cout << std::endl;
+}
+
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <new>
+#include <utility>
+
+namespace a2 {
+
+// Vector that keeps up to N elements inline and moves to the heap only beyond that. Sized for
+// the short sequences of the AST (terms of a series, arguments of an instruction), which then
+// live inside their owner and cost no allocation. Only the operations the AST needs.
+template <typename T, std::size_t N>
+class SmallVector {
+  static_assert(N > 0, "a SmallVector needs inline capacity");
+
+public:
+  using value_type = T;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  SmallVector() = default;
+
+  SmallVector(std::initializer_list<T> items) {
+    reserve(items.size());
+    for (auto& item : items) {
+      new (data_ + size_++) T(item);
+    }
+  }
+
+  SmallVector(const SmallVector& other) {
+    reserve(other.size_);
+    for (auto& item : other) {
+      new (data_ + size_++) T(item);
+    }
+  }
+
+  SmallVector(SmallVector&& other) noexcept { Take(other); }
+
+  SmallVector& operator=(const SmallVector& other) {
+    if (this != &other) {
+      clear();
+      reserve(other.size_);
+      for (auto& item : other) {
+        new (data_ + size_++) T(item);
+      }
+    }
+    return *this;
+  }
+
+  SmallVector& operator=(SmallVector&& other) noexcept {
+    if (this != &other) {
+      Release();
+      Take(other);
+    }
+    return *this;
+  }
+
+  ~SmallVector() { Release(); }
+
+  std::size_t size() const { return size_; }
+  std::size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+  bool IsInline() const { return data_ == Inline(); }
+
+  T& operator[](std::size_t i) { return data_[i]; }
+  const T& operator[](std::size_t i) const { return data_[i]; }
+  T& back() { return data_[size_ - 1]; }
+  const T& back() const { return data_[size_ - 1]; }
+
+  T* begin() { return data_; }
+  T* end() { return data_ + size_; }
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+
+  void reserve(std::size_t capacity) {
+    if (capacity <= capacity_) {
+      return;
+    }
+    auto grown = static_cast<T*>(::operator new(capacity * sizeof(T)));
+    for (std::uint32_t i = 0; i < size_; i++) {
+      new (grown + i) T(std::move(data_[i]));
+      data_[i].~T();
+    }
+    if (!IsInline()) {
+      ::operator delete(data_);
+    }
+    data_ = grown;
+    capacity_ = static_cast<std::uint32_t>(capacity);
+  }
+
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (size_ == capacity_) {
+      T item(std::forward<Args>(args)...);     // args may refer to an element that is about to move
+      reserve(capacity_ * 2);
+      return *new (data_ + size_++) T(std::move(item));
+    }
+    return *new (data_ + size_++) T(std::forward<Args>(args)...);
+  }
+
+  void push_back(const T& item) { emplace_back(item); }
+  void push_back(T&& item) { emplace_back(std::move(item)); }
+
+  void resize(std::size_t size) {
+    while (size_ > size) {
+      data_[--size_].~T();
+    }
+    reserve(size);
+    while (size_ < size) {
+      new (data_ + size_++) T();
+    }
+  }
+
+  void clear() { resize(0); }
+
+private:
+  T* Inline() { return reinterpret_cast<T*>(inline_); }
+  const T* Inline() const { return reinterpret_cast<const T*>(inline_); }
+
+  // leaves other empty and inline
+  void Take(SmallVector& other) {
+    if (other.IsInline()) {
+      data_ = Inline();
+      capacity_ = N;
+      for (size_ = 0; size_ < other.size_; size_++) {
+        new (data_ + size_) T(std::move(other.data_[size_]));
+      }
+      other.clear();
+    } else {
+      data_ = other.data_;
+      size_ = other.size_;
+      capacity_ = other.capacity_;
+      other.data_ = other.Inline();
+      other.size_ = 0;
+      other.capacity_ = N;
+    }
+  }
+
+  void Release() {
+    clear();
+    if (!IsInline()) {
+      ::operator delete(data_);
+      data_ = Inline();
+      capacity_ = N;
+    }
+  }
+
+  T* data_ = Inline();
+  std::uint32_t size_ = 0;
+  std::uint32_t capacity_ = N;
+  alignas(T) unsigned char inline_[N * sizeof(T)];
+};
+
+}
+
+namespace a2test {
+void TestSmallVector();
+}
@@ -0,0 +1,120 @@
+#include "source.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "stats.h"
+
+namespace a2 {
+
+std::unique_ptr<SourceBuffer> SourceBuffer::Map(const std::string& path) {
+#ifdef _WIN32
+  std::ifstream fs(path, std::ios::binary);
+  if (!fs.is_open()) { return nullptr; }
+  auto source = Read(fs);
+  source->path_ = path;
+  return source;
+#else
+  A2_PHASE(EPhase::kRead);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) { return nullptr; }
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  auto source = std::unique_ptr<SourceBuffer>(new SourceBuffer());
+  source->path_ = path;
+  std::size_t size = static_cast<std::size_t>(st.st_size);
+
+  if (size > 0) {     // mmap rejects empty ranges, an empty file simply has empty text
+    void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      close(fd);
+      return nullptr;
+    }
+    madvise(p, size, MADV_SEQUENTIAL);
+    source->mapping_ = p;
+    source->mapping_size_ = size;
+    source->text_ = std::string_view(static_cast<const char*>(p), size);
+  }
+
+  close(fd);          // the mapping stays valid
+  return source;
+#endif
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::Read(std::istream& from) {
+  A2_PHASE(EPhase::kRead);
+  auto source = std::unique_ptr<SourceBuffer>(new SourceBuffer());
+  source->owned_.assign(std::istreambuf_iterator<char>(from), std::istreambuf_iterator<char>());
+  source->text_ = source->owned_;
+  return source;
+}
+
+const LineIndex& SourceBuffer::Lines() const {
+  if (!indexed_) {
+    A2_PHASE(EPhase::kLines);
+    lines_ = LineIndex(text_);
+    indexed_ = true;
+  }
+  return lines_;
+}
+
+void SourceBuffer::Evict(std::size_t begin, std::size_t end) const {
+#ifndef _WIN32
+  if (mapping_ == nullptr) {
+    return;
+  }
+
+  // only whole pages inside the range, the ones at its edges may hold text that is still needed
+  auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  auto first = (begin + page - 1) / page * page;
+  auto last = std::min(end, mapping_size_) / page * page;
+  if (first < last) {
+    madvise(static_cast<char*>(mapping_) + first, last - first, MADV_DONTNEED);
+  }
+#endif
+}
+
+// multiplicative mix over 8-byte words, several GB/s so hashing a file is cheap next to parsing it
+std::uint64_t HashText(std::string_view text) {
+  constexpr std::uint64_t kMul = 0x9e3779b97f4a7c15ull;
+
+  std::uint64_t h = (text.length() + 1) * kMul;
+  std::size_t i = 0;
+  for (; i + 8 <= text.length(); i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, text.data() + i, 8);
+    h = (h ^ word) * kMul;
+    h ^= h >> 29;
+  }
+
+  std::uint64_t tail = 0;
+  if (i < text.length()) {
+    std::memcpy(&tail, text.data() + i, text.length() - i);
+  }
+  h = (h ^ tail) * kMul;
+  return h ^ (h >> 32);
+}
+
+SourceBuffer::~SourceBuffer() {
+#ifndef _WIN32
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+#endif
+}
+
+}
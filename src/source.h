@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "preprocess.h"
+
+namespace a2 {
+
+// 64-bit hash of a text, see SourceBuffer::Hash
+std::uint64_t HashText(std::string_view text);
+
+// Read-only text of one .a2 input. Parsed trees hold views into it, so it must outlive them.
+class SourceBuffer {
+public:
+  // memory-maps the file, returns nullptr if it cannot be opened
+  static std::unique_ptr<SourceBuffer> Map(const std::string& path);
+
+  static std::unique_ptr<SourceBuffer> Read(std::istream& from);
+
+  SourceBuffer(const SourceBuffer&) = delete;
+  SourceBuffer& operator=(const SourceBuffer&) = delete;
+  ~SourceBuffer();
+
+  std::string_view Text() const { return text_; }
+  bool IsMapped() const { return mapping_ != nullptr; }
+
+  // the path given to Map, empty for a buffer that was read from a stream
+  const std::string& Path() const { return path_; }
+
+  // built on first use, a cache hit on Hash() never needs it
+  const LineIndex& Lines() const;
+
+  // Tells the system a range of the text will not be read again soon, e.g. by a streaming pass,
+  // so a mapped file's pages can leave memory. Reading it later still works. No-op unless mapped.
+  void Evict(std::size_t begin, std::size_t end) const;
+
+  // 64-bit hash of the text, identifies the content for parse caches
+  std::uint64_t Hash() const { return HashText(text_); }
+
+private:
+  SourceBuffer() = default;
+
+  std::string_view text_;
+  std::string owned_;
+  std::string path_;
+  void* mapping_ = nullptr;
+  std::size_t mapping_size_ = 0;
+  mutable LineIndex lines_;
+  mutable bool indexed_ = false;
+};
+
+}
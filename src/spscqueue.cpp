@@ -0,0 +1,68 @@
+#include "spscqueue.h"
+
+#include <sstream>
+#include <thread>
+
+#include "testutil.h"
+
+namespace a2test {
+
+using namespace a2;
+
+void TestSpscQueue() {
+  PutTestHeader("SpscQueue", std::cout);
+
+  {
+    std::stringstream ss;
+    PutTestId(1, ss);
+    SpscQueue<std::size_t> queue(4);      // far fewer slots than items, both sides stall
+    std::thread producer([&queue]() {
+      for (std::size_t i = 1; i <= 100000; i++) {
+        queue.Push(std::size_t(i));
+      }
+      queue.Close();
+    });
+
+    std::size_t sum = 0;
+    std::size_t last = 0;
+    bool ordered = true;
+    for (std::size_t item = 0; queue.Pop(item);) {
+      ordered = ordered && item == last + 1;
+      last = item;
+      sum += item;
+    }
+    producer.join();
+
+    if (AssertEqual("sum", std::size_t(100000) * 100001 / 2, sum, ss) && AssertEqual("ordered", true, ordered, ss) &&
+        AssertEqual("items", std::size_t(100000), queue.GetStats().items, ss)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss.str();
+    }
+  }
+  {
+    std::stringstream ss;
+    PutTestId(2, ss);
+    SpscQueue<std::size_t> queue(2);
+    std::size_t pushed = 0;
+    std::thread producer([&queue, &pushed]() {
+      while (queue.Push(std::size_t(pushed))) {
+        pushed++;
+      }
+    });
+
+    std::size_t item = 0;
+    queue.Pop(item);
+    queue.Close();        // the consumer gives up, the producer must not block forever
+    producer.join();
+
+    if (AssertEqual("pushed at most capacity + 1", true, pushed <= 3, ss)) {
+      std::cout << ".";
+    } else {
+      std::cout << std::endl << ss.str();
+    }
+  }
+  std::cout << std::endl;
+}
+
+}
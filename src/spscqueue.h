@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace a2 {
+
+struct QueueStats {
+  std::size_t items = 0;
+  std::size_t full_stalls = 0;      // producer waits
+  std::size_t empty_stalls = 0;     // consumer waits
+  double full_seconds = 0;
+  double empty_seconds = 0;
+};
+
+// Bounded single-producer single-consumer queue between two pipeline stages. A ring of slots
+// indexed by two counters, each written by one side only, so neither side takes a lock. A side
+// that finds the queue full (or empty) stalls: it yields until the other side catches up, and
+// counts the stall and the time spent in it.
+template <typename T>
+class SpscQueue {
+public:
+  // capacity is rounded up to a power of two
+  explicit SpscQueue(std::size_t capacity) {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots_ = std::make_unique<T[]>(size);
+    mask_ = size - 1;
+  }
+
+  // Producer side, waits while the queue is full. False, and the item dropped, once the queue is
+  // closed, which the consumer does to stop the producer.
+  bool Push(T&& item) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) > mask_) {
+      auto start = std::chrono::steady_clock::now();
+      while (tail - head_.load(std::memory_order_acquire) > mask_) {
+        if (closed_.load(std::memory_order_acquire)) {
+          return false;
+        }
+        std::this_thread::yield();
+      }
+      full_stalls_++;
+      full_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    if (closed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    slots_[tail & mask_] = std::move(item);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, waits while the queue is empty. False once it is closed and drained.
+  bool Pop(T& item) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      auto start = std::chrono::steady_clock::now();
+      while (head == tail_.load(std::memory_order_acquire)) {
+        if (closed_.load(std::memory_order_acquire) && head == tail_.load(std::memory_order_acquire)) {
+          return false;
+        }
+        std::this_thread::yield();
+      }
+      empty_stalls_++;
+      empty_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    item = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // either side: the producer has no more items, or the consumer takes no more
+  void Close() { closed_.store(true, std::memory_order_release); }
+
+  // once both sides are done
+  QueueStats GetStats() const {
+    return {tail_.load(), full_stalls_, empty_stalls_, full_seconds_, empty_seconds_};
+  }
+
+private:
+  std::unique_ptr<T[]> slots_;
+  std::size_t mask_ = 0;
+  std::atomic<bool> closed_{false};
+
+  alignas(64) std::atomic<std::size_t> head_{0};    // next slot to pop, written by the consumer
+  std::size_t empty_stalls_ = 0;
+  double empty_seconds_ = 0;
+
+  alignas(64) std::atomic<std::size_t> tail_{0};    // next slot to push, written by the producer
+  std::size_t full_stalls_ = 0;
+  double full_seconds_ = 0;
+};
+
+}
+
+namespace a2test {
+void TestSpscQueue();
+}
@@ -0,0 +1,152 @@
+#include "stats.h"
+
+#include <iomanip>
+#include <sstream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "testutil.h"
+
+namespace {
+
+using namespace a2;
+
+std::atomic<std::uint64_t> gAllocations{0};
+std::atomic<std::uint64_t> gAllocatedBytes{0};
+std::atomic<std::uint32_t> gThreads{0};
+
+// small numbers for trace viewers, in the order threads first record a phase
+std::uint32_t ThreadIndex() {
+  thread_local std::uint32_t index = gThreads.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+// in KiB, 0 where unknown
+std::size_t PeakRss() {
+#ifndef _WIN32
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    return static_cast<std::size_t>(usage.ru_maxrss);
+  }
+#endif
+  return 0;
+}
+
+double Us(Stats::Clock::duration d) {
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+}
+
+namespace a2 {
+
+void CountAllocation(std::size_t bytes) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  gAllocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+Stats& Stats::Global() {
+  static Stats stats;
+  return stats;
+}
+
+void Stats::Enable(bool trace) {
+  origin_ = Clock::now();
+  tracing_ = trace;
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Stats::Record(EPhase phase, Clock::time_point start, Clock::time_point end) {
+  auto p = static_cast<std::size_t>(phase);
+  phase_ns_[p].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+      std::memory_order_relaxed);
+  phase_calls_[p].fetch_add(1, std::memory_order_relaxed);
+  if (tracing_) {
+    auto thread = ThreadIndex();
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back({phase, thread, start, end});
+  }
+}
+
+void Stats::Dump(std::ostream& out) const {
+  out << std::endl << std::left << std::setw(20) << "phase" << std::right << std::setw(10) << "calls"
+      << std::setw(12) << "ms" << std::endl;
+  for (std::size_t p = 0; p < kPhases; p++) {
+    if (phase_calls_[p] == 0) {
+      continue;
+    }
+    out << std::left << std::setw(20) << gPhaseToStr[static_cast<EPhase>(p)] << std::right << std::setw(10)
+        << phase_calls_[p] << std::setw(12) << std::fixed << std::setprecision(2) << phase_ns_[p] / 1e6 << std::endl;
+  }
+  for (std::size_t c = 0; c < kCounters; c++) {
+    out << std::left << std::setw(20) << gCounterToStr[static_cast<ECounter>(c)] << std::right << std::setw(10)
+        << counters_[c] << std::endl;
+  }
+  out << std::left << std::setw(20) << "allocations" << std::right << std::setw(10) << gAllocations
+      << std::setw(12) << gAllocatedBytes / 1024 << " KiB" << std::endl;
+  out << std::left << std::setw(20) << "peak rss" << std::right << std::setw(22) << PeakRss() << " KiB" << std::endl;
+  out << std::left << std::setw(20) << "wall" << std::right << std::setw(22) << std::setprecision(2)
+      << Us(Clock::now() - origin_) / 1000 << " ms" << std::endl;
+}
+
+void Stats::WriteTrace(std::ostream& out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::stringstream json;
+  json << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+  for (auto& e : events_) {
+    json << "\n{\"name\":\"" << gPhaseToStr[e.phase] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+         << ",\"ts\":" << Us(e.start - origin_) << ",\"dur\":" << Us(e.end - e.start) << "},";
+  }
+  json << "\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":" << Us(Clock::now() - origin_)
+       << ",\"args\":{";
+  for (std::size_t c = 0; c < kCounters; c++) {
+    json << "\"" << gCounterToStr[static_cast<ECounter>(c)] << "\":" << counters_[c] << ",";
+  }
+  json << "\"allocations\":" << gAllocations << ",\"peak rss KiB\":" << PeakRss() << "}}\n],\"displayTimeUnit\":\"ms\"}\n";
+  auto text = json.str();
+  out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestStats() {
+  PutTestHeader("Stats", std::cout);
+
+  std::stringstream ss;
+  PutTestId(1, ss);
+  Stats stats;
+  stats.Enable(true);
+  auto start = Stats::Clock::now();
+  stats.Record(EPhase::kTokenize, start, start + std::chrono::milliseconds(2));
+  stats.Record(EPhase::kTokenize, start, start + std::chrono::milliseconds(1));
+  stats.Count(ECounter::kCodeLines, 7);
+
+  std::stringstream table;
+  stats.Dump(table);
+  std::stringstream trace;
+  stats.WriteTrace(trace);
+  auto json = trace.str();
+
+  std::size_t events = 0;
+  for (auto at = json.find("\"ph\":\"X\""); at != std::string::npos; at = json.find("\"ph\":\"X\"", at + 1)) {
+    events++;
+  }
+  if (AssertEqual("tokenize row", true, table.str().find("tokenize                     2        3.00") != std::string::npos, ss) &&
+      AssertEqual("code lines", true, table.str().find("code lines                   7") != std::string::npos, ss) &&
+      AssertEqual("events", std::size_t(2), events, ss) &&
+      AssertEqual("counter", true, json.find("\"code lines\":7") != std::string::npos, ss) &&
+      AssertEqual("json", true, json.rfind("{\"traceEvents\":[", 0) == 0 && json.substr(json.size() - 2) == "}\n", ss)) {
+    std::cout << ".";
+  } else {
+    std::cout << std::endl << ss.str();
+  }
+  std::cout << std::endl;
+}
+
+}
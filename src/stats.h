@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "util.h"
+
+// 0 compiles every A2_PHASE and A2_COUNT out (cmake -DA2_STATS=OFF)
+#ifndef A2_STATS
+#define A2_STATS 1
+#endif
+
+namespace a2 {
+
+enum class EPhase : std::uint8_t {
+  kRead,          // reading or mapping a source
+  kLines,         // line index of a source
+  kTokenize,      // one block
+  kMerge,         // blocks and includes into the program
+  kFold,          // constant arithmetic
+  kAssemble,      // encoding the table and code into pieces
+  kLink,
+  kWrite,         // formatting and writing the image
+  kStream,        // one pass of a streamed parse
+  kCount
+};
+
+constexpr EnumTable<EPhase, 9> gPhaseToStr = {{
+  "read", "lines", "tokenize", "merge", "fold", "assemble", "link", "write", "stream"
+}};
+static_assert(NamesAll(gPhaseToStr));
+
+enum class ECounter : std::uint8_t {
+  kConstantLines,
+  kTableLines,
+  kCodeLines,
+  kScans,               // calls into the tokenizer's scanners
+  kConstantLookups,
+  kCount
+};
+
+constexpr EnumTable<ECounter, 5> gCounterToStr = {{
+  "constant lines", "table lines", "code lines", "tokenizer scans", "constant lookups"
+}};
+static_assert(NamesAll(gCounterToStr));
+
+// every operator new of the executable, if it counts them
+void CountAllocation(std::size_t bytes);
+
+// Per-phase time and counters of a run. Disabled (the default) it only costs the check of a
+// flag at each phase and counter; enabled, phases add to atomics and, when tracing, append an
+// event under a lock, so phases should be coarse (a block, not a line).
+class Stats {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static Stats& Global();
+
+  Stats() = default;
+
+  void Enable(bool trace);
+  bool Enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  void Count(ECounter counter, std::size_t n) {
+    counters_[static_cast<std::size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+  }
+  void Record(EPhase phase, Clock::time_point start, Clock::time_point end);
+
+  // phases (time summed over threads), counters, allocations and peak RSS
+  void Dump(std::ostream& out) const;
+
+  // Chrome trace-event JSON (chrome://tracing, Perfetto): a complete event per phase with its
+  // thread, and the counters at the end
+  void WriteTrace(std::ostream& out) const;
+
+private:
+  static constexpr std::size_t kPhases = static_cast<std::size_t>(EPhase::kCount);
+  static constexpr std::size_t kCounters = static_cast<std::size_t>(ECounter::kCount);
+
+  struct Event {
+    EPhase phase;
+    std::uint32_t thread;
+    Clock::time_point start;
+    Clock::time_point end;
+  };
+
+  std::atomic<bool> enabled_{false};
+  bool tracing_ = false;
+  Clock::time_point origin_;
+  std::array<std::atomic<std::uint64_t>, kPhases> phase_ns_{};
+  std::array<std::atomic<std::uint64_t>, kPhases> phase_calls_{};
+  std::array<std::atomic<std::uint64_t>, kCounters> counters_{};
+
+  mutable std::mutex mutex_;
+  std::vector<Event> events_;
+};
+
+// times its scope as one phase of Stats::Global()
+class ScopedPhase {
+public:
+  explicit ScopedPhase(EPhase phase) : phase_(phase), enabled_(Stats::Global().Enabled()) {
+    if (enabled_) {
+      start_ = Stats::Clock::now();
+    }
+  }
+
+  ~ScopedPhase() {
+    if (enabled_) {
+      Stats::Global().Record(phase_, start_, Stats::Clock::now());
+    }
+  }
+
+  ScopedPhase(const ScopedPhase&) = delete;
+  ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+  EPhase phase_;
+  bool enabled_;
+  Stats::Clock::time_point start_;
+};
+
+}
+
+#define A2_STATS_CONCAT_(a, b) a##b
+#define A2_STATS_CONCAT(a, b) A2_STATS_CONCAT_(a, b)
+
+#if A2_STATS
+// n is only evaluated while stats are enabled
+#define A2_PHASE(phase) ::a2::ScopedPhase A2_STATS_CONCAT(a2_phase_, __LINE__)(phase)
+#define A2_COUNT(counter, n) \
+  do { if (::a2::Stats::Global().Enabled()) { ::a2::Stats::Global().Count(counter, n); } } while (0)
+#else
+#define A2_PHASE(phase) do {} while (0)
+#define A2_COUNT(counter, n) do {} while (0)
+#endif
+
+namespace a2test {
+void TestStats();
+}
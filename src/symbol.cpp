@@ -0,0 +1,98 @@
+#include "symbol.h"
+
+#include <cstring>
+
+#include "exception.h"
+
+namespace a2 {
+
+SymbolTable& SymbolTable::Global() {
+  static SymbolTable table;
+  return table;
+}
+
+SymbolTable::SymbolTable() {
+  AddName({});
+}
+
+Symbol SymbolTable::Intern(std::string_view name) {
+  auto& shard = shards_[std::hash<std::string_view>()(name) % kShardCount];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  shard.stats.references++;
+  shard.stats.reference_bytes += name.length();
+
+  if (name.empty()) {
+    return Symbol();
+  }
+
+  auto itr = shard.ids.find(name);
+  if (itr != shard.ids.end()) {
+    return Symbol(itr->second);
+  }
+
+  auto stored = Store(shard, name);
+  auto id = AddName(stored);
+  shard.ids.emplace(stored, id);
+
+  shard.stats.distinct++;
+  shard.stats.distinct_bytes += name.length();
+  return Symbol(id);
+}
+
+Symbol SymbolTable::Find(std::string_view name) const {
+  auto& shard = shards_[std::hash<std::string_view>()(name) % kShardCount];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  auto itr = shard.ids.find(name);
+  return itr != shard.ids.end() ? Symbol(itr->second) : Symbol();
+}
+
+SymbolTable::Stats SymbolTable::GetStats() const {
+  Stats total;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total.distinct += shard.stats.distinct;
+    total.references += shard.stats.references;
+    total.distinct_bytes += shard.stats.distinct_bytes;
+    total.reference_bytes += shard.stats.reference_bytes;
+  }
+  return total;
+}
+
+// called with the shard of the name locked
+std::string_view SymbolTable::Store(Shard& shard, std::string_view name) {
+  if (name.length() > kBlockSize - shard.block_used) {
+    if (name.length() > kBlockSize / 4) {      // large names get a block of their own
+      shard.blocks.emplace_back(new char[name.length()]);
+      std::memcpy(shard.blocks.back().get(), name.data(), name.length());
+      return std::string_view(shard.blocks.back().get(), name.length());
+    }
+    shard.blocks.emplace_back(new char[kBlockSize]);
+    shard.block = shard.blocks.back().get();
+    shard.block_used = 0;
+  }
+
+  char* p = shard.block + shard.block_used;
+  std::memcpy(p, name.data(), name.length());
+  shard.block_used += name.length();
+  return std::string_view(p, name.length());
+}
+
+std::uint32_t SymbolTable::AddName(std::string_view stored) {
+  std::lock_guard<std::mutex> lock(names_mutex_);
+
+  auto id = next_id_;
+  auto chunk = id >> kChunkBits;
+  if (chunk >= kMaxChunks) {
+    throw ParseException(EParseErrorCode::kTooManyNames);
+  }
+  if (!chunks_[chunk]) {
+    chunks_[chunk].reset(new std::string_view[kChunkMask + 1]);
+  }
+  chunks_[chunk][id & kChunkMask] = stored;
+  next_id_++;
+  return id;
+}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace a2 {
+
+// Interned identifier. Equal names always get the same id, so comparing and hashing symbols
+// never touches the characters. Id 0 is the empty name.
+class Symbol {
+public:
+  constexpr Symbol() : id_(0) {}
+
+  std::uint32_t Id() const { return id_; }
+  bool Empty() const { return id_ == 0; }
+  std::string_view Str() const;
+
+  bool operator==(Symbol other) const { return id_ == other.id_; }
+  bool operator!=(Symbol other) const { return id_ != other.id_; }
+  bool operator<(Symbol other) const { return id_ < other.id_; }
+
+private:
+  friend class SymbolTable;
+  explicit Symbol(std::uint32_t id) : id_(id) {}
+
+  std::uint32_t id_;
+};
+
+class SymbolTable {
+public:
+  struct Stats {
+    std::size_t distinct = 0;          // names in the table
+    std::size_t references = 0;        // Intern calls
+    std::size_t distinct_bytes = 0;    // characters stored once
+    std::size_t reference_bytes = 0;   // characters that separate strings would have held
+  };
+
+  // Names are never removed, so a process interns at most this many distinct names; Intern
+  // throws kTooManyNames past it.
+  static constexpr std::size_t kMaxNames = 1 << 24;
+
+  // process-wide table used by the tokenizer
+  static SymbolTable& Global();
+
+  SymbolTable();
+
+  // Safe to call from several threads: names are spread over shards that each have their own
+  // lock, so threads interning different names rarely wait on each other. Ids are handed out in
+  // first-come order, so they are only reproducible when a single thread interns.
+  Symbol Intern(std::string_view name);
+
+  // the symbol of an already interned name, empty if the name was never interned
+  Symbol Find(std::string_view name) const;
+
+  // lock free, the symbol must come from Intern or Find
+  std::string_view Str(Symbol symbol) const { return chunks_[symbol.Id() >> kChunkBits][symbol.Id() & kChunkMask]; }
+
+  Stats GetStats() const;
+
+private:
+  static constexpr std::size_t kBlockSize = 64 * 1024;
+  static constexpr std::size_t kShardCount = 64;
+  static constexpr std::size_t kChunkBits = 12;
+  static constexpr std::uint32_t kChunkMask = (1u << kChunkBits) - 1;
+  static constexpr std::size_t kMaxChunks = kMaxNames >> kChunkBits;
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<std::string_view, std::uint32_t> ids;
+    std::vector<std::unique_ptr<char[]>> blocks;      // name storage, never moves
+    char* block = nullptr;
+    std::size_t block_used = kBlockSize;
+    Stats stats;
+  };
+
+  static std::string_view Store(Shard& shard, std::string_view name);
+  std::uint32_t AddName(std::string_view stored);
+
+  mutable Shard shards_[kShardCount];
+
+  // id -> name in fixed chunks, a chunk never moves once allocated so readers need no lock
+  std::mutex names_mutex_;
+  std::uint32_t next_id_ = 0;
+  std::unique_ptr<std::string_view[]> chunks_[kMaxChunks];
+};
+
+inline Symbol Intern(std::string_view name) { return SymbolTable::Global().Intern(name); }
+
+inline std::string_view Symbol::Str() const { return SymbolTable::Global().Str(*this); }
+
+inline std::ostream& operator<<(std::ostream& out, Symbol symbol) { return out << symbol.Str(); }
+
+}
+
+template<>
+struct std::hash<a2::Symbol> {
+  std::size_t operator()(a2::Symbol symbol) const { return symbol.Id(); }
+};
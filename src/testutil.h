@@ -3,11 +3,12 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <vector>
 
 namespace a2test {
 
-void PutTestHeader(const char* header, std::ostream& out) { out << std::endl << "== " << header << " ==" << std::endl; }
-void PutTestId(std::size_t id, std::ostream& out) { out  << "  " << std::setw(3) << std::setfill('0') << id << ": "; }
+inline void PutTestHeader(const char* header, std::ostream& out) { out << std::endl << "== " << header << " ==" << std::endl; }
+inline void PutTestId(std::size_t id, std::ostream& out) { out  << "  " << std::setw(3) << std::setfill('0') << id << ": "; }
 
 template<typename T>
 bool AssertEqual(const char* name, const T& expected, const T& actual, std::ostream& out) {
@@ -33,11 +34,11 @@ bool AssertEqual(const char* name, const std::vector<T>& expected, const std::ve
   return false;
 }
 
-void Passed(std::ostream& out) { std::cout << "pass" << std::endl; }
+inline void Passed(std::ostream& out) { std::cout << "pass" << std::endl; }
 
 template<typename T>
 void ExceptionNotThrown(const T& expected, std::ostream& out) { out << "* expected exception not thrown: " << expected << std::endl; }
 
-void UnexpectedException(std::ostream& out) { out << "* unexpected exception" << std::endl; }
+inline void UnexpectedException(std::ostream& out) { out << "* unexpected exception" << std::endl; }
 
 }
@@ -0,0 +1,139 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <sstream>
+
+#include "exception.h"
+#include "testutil.h"
+
+namespace a2 {
+
+ThreadPool::ThreadPool(std::size_t threads) {
+  if (threads == 0) {
+    threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  for (std::size_t i = 1; i < threads; i++) {
+    workers_.emplace_back([this] { WorkerMain(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::ParallelFor(std::size_t count, const std::function<void(std::size_t)>& task) {
+  if (count == 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> loop(loop_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    next_ = 0;
+    error_ = nullptr;
+    busy_ = workers_.size();
+    generation_++;
+  }
+  start_.notify_all();
+
+  RunTasks();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return busy_ == 0; });
+  task_ = nullptr;
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+void ThreadPool::WorkerMain() {
+  std::size_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+
+    RunTasks();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      busy_--;
+    }
+    done_.notify_one();
+  }
+}
+
+void ThreadPool::RunTasks() {
+  for (;;) {
+    std::size_t i;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (next_ >= count_ || error_) {
+        return;
+      }
+      i = next_++;
+    }
+
+    try {
+      (*task_)(i);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+  }
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+void TestThreadPool() {
+  PutTestHeader("ThreadPool", std::cout);
+
+  for (std::size_t threads : {1, 4}) {
+    std::stringstream ss;
+    PutTestId(threads, ss);
+    ThreadPool pool(threads);
+    std::vector<std::size_t> squares(1000);
+    std::atomic<std::size_t> calls(0);
+    pool.ParallelFor(squares.size(), [&](std::size_t i) { squares[i] = i * i; calls++; });
+    pool.ParallelFor(10, [&](std::size_t) { calls++; });
+
+    bool pass = AssertEqual("calls", std::size_t(1010), calls.load(), ss) && 
+                AssertEqual("last square", std::size_t(999 * 999), squares.back(), ss);
+
+    try {
+      pool.ParallelFor(100, [](std::size_t i) { if (i == 50) { throw ParseException(EParseErrorCode::kUnexpected); } });
+      ExceptionNotThrown(gEParseErrorCodeToStr[EParseErrorCode::kUnexpected], ss);
+      pass = false;
+    } catch (const ParseException& pe) {
+      pass = pass && AssertEqual("exception", gEParseErrorCodeToStr[EParseErrorCode::kUnexpected], gEParseErrorCodeToStr[pe.Code], ss);
+    }
+
+    if (pass) { std::cout << "."; }
+    else { std::cout << std::endl << ss.str(); }
+  }
+  std::cout << std::endl;
+}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace a2 {
+
+// Fixed set of worker threads running index-parallel loops. The calling thread takes part in
+// every loop, so a pool of one thread runs loops inline and starts no thread at all.
+class ThreadPool {
+public:
+  // 0 picks the number of hardware threads
+  explicit ThreadPool(std::size_t threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  std::size_t Size() const { return workers_.size() + 1; }
+
+  // Calls task(i) for every i in [0, count) and returns once all calls are done. Indices are
+  // handed out one at a time, so uneven tasks balance out. The first exception thrown by a task
+  // is rethrown here after the loop drains. Loops called from several threads run one after the
+  // other; a task must not start a loop on its own pool.
+  void ParallelFor(std::size_t count, const std::function<void(std::size_t)>& task);
+
+private:
+  void WorkerMain();
+  void RunTasks();
+
+  std::vector<std::thread> workers_;
+  std::mutex loop_mutex_;          // held by the caller for the whole loop
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  std::size_t generation_ = 0;     // bumped for every loop, wakes the workers
+  std::size_t busy_ = 0;           // workers still inside the current loop
+  bool stop_ = false;
+
+  // current loop, set while holding mutex_
+  const std::function<void(std::size_t)>* task_ = nullptr;
+  std::size_t count_ = 0;
+  std::size_t next_ = 0;
+  std::exception_ptr error_;
+};
+
+}
+
+namespace a2test {
+void TestThreadPool();
+}
@@ -0,0 +1,599 @@
+#include "thumb.h"
+
+#include <iostream>
+#include <sstream>
+#include <iterator>
+#include <string_view>
+
+#include "exception.h"
+#include "testutil.h"
+
+namespace {
+
+using namespace a2;
+
+// Operand shapes. Low registers are r0-r7, 'any' is r0-r15.
+enum class EForm : std::uint8_t {
+  kNone,          // no operand
+  kImm8,          // imm8
+  kRdImm8,        // low, imm8                       rd in 8-10
+  kRdRm,          // low, low                        rm in 3-5, rd in 0-2
+  kRdRmImm5,      // low, low, imm5                  param 1: range is 1-32 (32 encoded as 0)
+  kRdRnRm,        // low, low, low                   rm in 6-8, rn in 3-5, rd in 0-2
+  kRdRnImm3,      // low, low, imm3
+  kRtRnImm5,      // low, low (, imm)                imm scaled down by param bits
+  kRtSpImm8,      // low, sp (, imm)                 imm is a multiple of 4 up to 1020, param 1: imm required
+  kSpImm7,        // sp, imm                         imm is a multiple of 4 up to 508
+  kHiRdRm,        // any, any                        rd bit 3 goes to bit 7
+  kHiRm,          // any                             rm in 3-6
+  kBranchCond,    // label                           B<cond>, +-256 bytes
+  kBranch,        // label                           B, +-2KB
+  kBranchLink,    // label                           BL, +-16MB
+  kRdLabel,       // low, label                      LDR literal, ADR
+  kRegList,       // low... (and param register)     PUSH lr / POP pc set bit 8
+  kRnRegList      // low, low...                     rn in 8-10
+};
+
+struct Form {
+  std::string_view name;
+  EForm form;
+  std::uint32_t opcode;     // above 0xffff for 32-bit instructions, first halfword in the low bits
+  std::uint8_t param = 0;
+};
+
+// ARMv6-M instruction set. Forms of one mnemonic are adjacent and tried in order.
+constexpr Form gForms[] = {
+  {"ADCS",  EForm::kRdRm,        0x4140},
+  {"ADD",   EForm::kSpImm7,      0xb000},
+  {"ADD",   EForm::kRtSpImm8,    0xa800, 1},     // ADD(rd, sp) is rd = rd + sp, a kHiRdRm
+  {"ADD",   EForm::kHiRdRm,      0x4400},
+  {"ADDS",  EForm::kRdRnImm3,    0x1c00},
+  {"ADDS",  EForm::kRdRnRm,      0x1800},
+  {"ADDS",  EForm::kRdImm8,      0x3000},
+  {"ADR",   EForm::kRdLabel,     0xa000},
+  {"ANDS",  EForm::kRdRm,        0x4000},
+  {"ASRS",  EForm::kRdRmImm5,    0x1000, 1},
+  {"ASRS",  EForm::kRdRm,        0x4100},
+  {"B",     EForm::kBranch,      0xe000},
+  {"BEQ",   EForm::kBranchCond,  0xd000},
+  {"BNE",   EForm::kBranchCond,  0xd100},
+  {"BCS",   EForm::kBranchCond,  0xd200},
+  {"BHS",   EForm::kBranchCond,  0xd200},
+  {"BCC",   EForm::kBranchCond,  0xd300},
+  {"BLO",   EForm::kBranchCond,  0xd300},
+  {"BMI",   EForm::kBranchCond,  0xd400},
+  {"BPL",   EForm::kBranchCond,  0xd500},
+  {"BVS",   EForm::kBranchCond,  0xd600},
+  {"BVC",   EForm::kBranchCond,  0xd700},
+  {"BHI",   EForm::kBranchCond,  0xd800},
+  {"BLS",   EForm::kBranchCond,  0xd900},
+  {"BGE",   EForm::kBranchCond,  0xda00},
+  {"BLT",   EForm::kBranchCond,  0xdb00},
+  {"BGT",   EForm::kBranchCond,  0xdc00},
+  {"BLE",   EForm::kBranchCond,  0xdd00},
+  {"BICS",  EForm::kRdRm,        0x4380},
+  {"BKPT",  EForm::kImm8,        0xbe00},
+  {"BL",    EForm::kBranchLink,  0xd000f000},
+  {"BLX",   EForm::kHiRm,        0x4780},
+  {"BX",    EForm::kHiRm,        0x4700},
+  {"CMN",   EForm::kRdRm,        0x42c0},
+  {"CMP",   EForm::kRdImm8,      0x2800},
+  {"CMP",   EForm::kRdRm,        0x4280},
+  {"CMP",   EForm::kHiRdRm,      0x4500},
+  {"CPSID", EForm::kNone,        0xb672},
+  {"CPSIE", EForm::kNone,        0xb662},
+  {"DMB",   EForm::kNone,        0x8f5ff3bf},
+  {"DSB",   EForm::kNone,        0x8f4ff3bf},
+  {"EORS",  EForm::kRdRm,        0x4040},
+  {"ISB",   EForm::kNone,        0x8f6ff3bf},
+  {"LDM",   EForm::kRnRegList,   0xc800},
+  {"LDR",   EForm::kRtSpImm8,    0x9800},
+  {"LDR",   EForm::kRtRnImm5,    0x6800, 2},
+  {"LDR",   EForm::kRdRnRm,      0x5800},
+  {"LDR",   EForm::kRdLabel,     0x4800},
+  {"LDRB",  EForm::kRtRnImm5,    0x7800},
+  {"LDRB",  EForm::kRdRnRm,      0x5c00},
+  {"LDRH",  EForm::kRtRnImm5,    0x8800, 1},
+  {"LDRH",  EForm::kRdRnRm,      0x5a00},
+  {"LDRSB", EForm::kRdRnRm,      0x5600},
+  {"LDRSH", EForm::kRdRnRm,      0x5e00},
+  {"LSLS",  EForm::kRdRmImm5,    0x0000},
+  {"LSLS",  EForm::kRdRm,        0x4080},
+  {"LSRS",  EForm::kRdRmImm5,    0x0800, 1},
+  {"LSRS",  EForm::kRdRm,        0x40c0},
+  {"MOV",   EForm::kHiRdRm,      0x4600},
+  {"MOVS",  EForm::kRdImm8,      0x2000},
+  {"MOVS",  EForm::kRdRm,        0x0000},
+  {"MULS",  EForm::kRdRm,        0x4340},
+  {"MVNS",  EForm::kRdRm,        0x43c0},
+  {"NEGS",  EForm::kRdRm,        0x4240},
+  {"NOP",   EForm::kNone,        0xbf00},
+  {"ORRS",  EForm::kRdRm,        0x4300},
+  {"POP",   EForm::kRegList,     0xbc00, 15},
+  {"PUSH",  EForm::kRegList,     0xb400, 14},
+  {"REV",   EForm::kRdRm,        0xba00},
+  {"REVSH", EForm::kRdRm,        0xbac0},
+  {"RORS",  EForm::kRdRm,        0x41c0},
+  {"RSBS",  EForm::kRdRm,        0x4240},
+  {"SBCS",  EForm::kRdRm,        0x4180},
+  {"SEV",   EForm::kNone,        0xbf40},
+  {"STM",   EForm::kRnRegList,   0xc000},
+  {"STR",   EForm::kRtSpImm8,    0x9000},
+  {"STR",   EForm::kRtRnImm5,    0x6000, 2},
+  {"STR",   EForm::kRdRnRm,      0x5000},
+  {"STRB",  EForm::kRtRnImm5,    0x7000},
+  {"STRB",  EForm::kRdRnRm,      0x5400},
+  {"STRH",  EForm::kRtRnImm5,    0x8000, 1},
+  {"STRH",  EForm::kRdRnRm,      0x5200},
+  {"SUB",   EForm::kSpImm7,      0xb080},
+  {"SUBS",  EForm::kRdRnImm3,    0x1e00},
+  {"SUBS",  EForm::kRdRnRm,      0x1a00},
+  {"SUBS",  EForm::kRdImm8,      0x3800},
+  {"SVC",   EForm::kImm8,        0xdf00},
+  {"SXTB",  EForm::kRdRm,        0xb240},
+  {"SXTH",  EForm::kRdRm,        0xb200},
+  {"TST",   EForm::kRdRm,        0x4200},
+  {"UDF",   EForm::kImm8,        0xde00},
+  {"UXTB",  EForm::kRdRm,        0xb2c0},
+  {"UXTH",  EForm::kRdRm,        0xb280},
+  {"WFE",   EForm::kNone,        0xbf20},
+  {"WFI",   EForm::kNone,        0xbf30},
+  {"YIELD", EForm::kNone,        0xbf10}
+};
+
+constexpr std::size_t gFormCount = std::size(gForms);
+
+// Mnemonics are looked up through a perfect hash built at compile time: FindSeed tries FNV-1a
+// seeds until every mnemonic lands in its own slot, so a lookup is one hash and one compare.
+constexpr std::size_t kSlotCount = 512;
+constexpr std::uint8_t kEmptySlot = 0xff;
+
+static_assert(gFormCount < kEmptySlot, "form index must fit a slot");
+
+constexpr std::size_t Slot(std::string_view name, std::uint32_t seed) {
+  std::uint32_t h = 2166136261u ^ seed;
+  for (auto c : name) {
+    h = (h ^ static_cast<unsigned char>(c & ~0x20)) * 16777619u;     // upper case, names are letters only
+  }
+  return (h ^ (h >> 15)) & (kSlotCount - 1);
+}
+
+constexpr bool SameName(std::string_view upper, std::string_view name) {
+  if (upper.length() != name.length()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < name.length(); i++) {
+    if (upper[i] != (name[i] & ~0x20)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+constexpr bool FormsAreGrouped() {
+  for (std::size_t i = 1; i < gFormCount; i++) {
+    if (gForms[i].name == gForms[i - 1].name) {
+      continue;
+    }
+    for (std::size_t j = 0; j < i; j++) {
+      if (gForms[j].name == gForms[i].name) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static_assert(FormsAreGrouped(), "forms of one mnemonic must be adjacent");
+
+constexpr std::uint32_t FindSeed() {
+  for (std::uint32_t seed = 0; ; seed++) {
+    bool used[kSlotCount] = {};
+    bool collided = false;
+    for (std::size_t i = 0; i < gFormCount && !collided; i++) {
+      if (i > 0 && gForms[i].name == gForms[i - 1].name) {
+        continue;
+      }
+      auto slot = Slot(gForms[i].name, seed);
+      collided = used[slot];
+      used[slot] = true;
+    }
+    if (!collided) {
+      return seed;
+    }
+  }
+}
+
+struct SlotTable {
+  std::uint8_t first[kSlotCount];     // index of the first form of the mnemonic in the slot
+};
+
+constexpr std::uint32_t gSeed = FindSeed();
+
+constexpr SlotTable MakeSlotTable() {
+  SlotTable table{};
+  for (auto& first : table.first) {
+    first = kEmptySlot;
+  }
+  for (std::size_t i = gFormCount; i-- > 0; ) {
+    table.first[Slot(gForms[i].name, gSeed)] = static_cast<std::uint8_t>(i);
+  }
+  return table;
+}
+
+constexpr SlotTable gSlots = MakeSlotTable();
+
+constexpr std::size_t FindForm(std::string_view name) {
+  auto first = gSlots.first[Slot(name, gSeed)];
+  return first != kEmptySlot && SameName(gForms[first].name, name) ? first : gFormCount;
+}
+
+static_assert(FindForm("nop") < gFormCount && gForms[FindForm("nop")].opcode == 0xbf00, "perfect hash lookup");
+static_assert(FindForm("NOPE") == gFormCount, "perfect hash rejects unknown names");
+
+// operands
+
+enum class EOperand : std::uint8_t {
+  kReg,
+  kImm,
+  kLabel
+};
+
+struct Operand {
+  EOperand type;
+  std::uint32_t value;      // register number or immediate
+  Symbol label;
+  std::int32_t addend;
+};
+
+constexpr std::size_t kMaxOperands = 16;
+constexpr std::uint32_t kSp = 13;
+
+// folded series: [reg], [num] or [@addr] [num]
+Operand ToOperand(const ArithSeries& series) {
+  if (series.size() == 1 && series[0].type == ERefedType::kReg) {
+    return {EOperand::kReg, static_cast<std::uint32_t>(series[0].num), {}, 0};
+  }
+  if (series.size() == 1 && series[0].type == ERefedType::kNum) {
+    if (series[0].num > 0xffffffff) {
+      throw ParseException(EParseErrorCode::kInvalidOperand);
+    }
+    return {EOperand::kImm, static_cast<std::uint32_t>(series[0].num), {}, 0};
+  }
+  if (!series.empty() && series.size() <= 2 && series[0].type == ERefedType::kAddr && series[0].op == ERefedOp::kNone &&
+      (series.size() == 1 || series[1].type == ERefedType::kNum)) {
+    auto addend = series.size() == 2 ? static_cast<std::int32_t>(series[1].num) : 0;
+    return {EOperand::kLabel, 0, series[0].ref, addend};
+  }
+  throw ParseException(EParseErrorCode::kInvalidOperand);
+}
+
+bool IsLow(const Operand& op) { return op.type == EOperand::kReg && op.value < 8; }
+bool IsReg(const Operand& op) { return op.type == EOperand::kReg; }
+bool IsSp(const Operand& op) { return op.type == EOperand::kReg && op.value == kSp; }
+bool IsImm(const Operand& op, std::uint32_t max, std::uint32_t align = 1) {
+  return op.type == EOperand::kImm && op.value <= max && op.value % align == 0;
+}
+
+void SetLabel(EncodedInstruction& encoded, const Operand& op, ERelocKind kind) {
+  encoded.target = op.label;
+  encoded.addend = op.addend;
+  encoded.kind = kind;
+}
+
+// register list of PUSH, POP, LDM and STM, each register once
+bool MakeRegList(const Operand* ops, std::size_t n, std::uint32_t extra, std::uint32_t& list) {
+  list = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    std::uint32_t bit = 0;
+    if (IsLow(ops[i])) {
+      bit = 1u << ops[i].value;
+    } else if (extra != 0 && IsReg(ops[i]) && ops[i].value == extra) {
+      bit = 1u << 8;
+    }
+    if (bit == 0 || (list & bit) != 0) {
+      return false;
+    }
+    list |= bit;
+  }
+  return n > 0;
+}
+
+// sets the operand bits if the operands fit the form
+bool Match(const Form& form, const Operand* ops, std::size_t n, EncodedInstruction& encoded) {
+  auto& v = encoded.bits.value;
+  v = form.opcode;
+
+  switch (form.form) {
+    case EForm::kNone:
+      return n == 0;
+    case EForm::kImm8:
+      if (n != 1 || !IsImm(ops[0], 0xff)) { return false; }
+      v |= ops[0].value;
+      return true;
+    case EForm::kRdImm8:
+      if (n != 2 || !IsLow(ops[0]) || !IsImm(ops[1], 0xff)) { return false; }
+      v |= ops[0].value << 8 | ops[1].value;
+      return true;
+    case EForm::kRdRm:
+      if (n != 2 || !IsLow(ops[0]) || !IsLow(ops[1])) { return false; }
+      v |= ops[1].value << 3 | ops[0].value;
+      return true;
+    case EForm::kRdRmImm5: {
+      if (n != 3 || !IsLow(ops[0]) || !IsLow(ops[1]) || ops[2].type != EOperand::kImm) { return false; }
+      auto imm = ops[2].value;
+      if (form.param != 0 ? (imm < 1 || imm > 32) : imm > 31) { return false; }
+      v |= (imm & 0x1f) << 6 | ops[1].value << 3 | ops[0].value;
+      return true;
+    }
+    case EForm::kRdRnRm:
+      if (n != 3 || !IsLow(ops[0]) || !IsLow(ops[1]) || !IsLow(ops[2])) { return false; }
+      v |= ops[2].value << 6 | ops[1].value << 3 | ops[0].value;
+      return true;
+    case EForm::kRdRnImm3:
+      if (n != 3 || !IsLow(ops[0]) || !IsLow(ops[1]) || !IsImm(ops[2], 7)) { return false; }
+      v |= ops[2].value << 6 | ops[1].value << 3 | ops[0].value;
+      return true;
+    case EForm::kRtRnImm5: {
+      if (n < 2 || n > 3 || !IsLow(ops[0]) || !IsLow(ops[1])) { return false; }
+      if (n == 3 && !IsImm(ops[2], 31u << form.param, 1u << form.param)) { return false; }
+      auto imm = n == 3 ? ops[2].value >> form.param : 0;
+      v |= imm << 6 | ops[1].value << 3 | ops[0].value;
+      return true;
+    }
+    case EForm::kRtSpImm8: {
+      if (n < (form.param != 0 ? 3 : 2) || n > 3 || !IsLow(ops[0]) || !IsSp(ops[1])) { return false; }
+      if (n == 3 && !IsImm(ops[2], 1020, 4)) { return false; }
+      auto imm = n == 3 ? ops[2].value >> 2 : 0;
+      v |= ops[0].value << 8 | imm;
+      return true;
+    }
+    case EForm::kSpImm7:
+      if (n != 2 || !IsSp(ops[0]) || !IsImm(ops[1], 508, 4)) { return false; }
+      v |= ops[1].value >> 2;
+      return true;
+    case EForm::kHiRdRm:
+      if (n != 2 || !IsReg(ops[0]) || !IsReg(ops[1])) { return false; }
+      v |= (ops[0].value & 8) << 4 | ops[1].value << 3 | (ops[0].value & 7);
+      return true;
+    case EForm::kHiRm:
+      if (n != 1 || !IsReg(ops[0])) { return false; }
+      v |= ops[0].value << 3;
+      return true;
+    case EForm::kBranchCond:
+    case EForm::kBranch:
+    case EForm::kBranchLink:
+      if (n != 1 || ops[0].type != EOperand::kLabel) { return false; }
+      SetLabel(encoded, ops[0], form.form == EForm::kBranchCond ? ERelocKind::kThumbB8 :
+                                form.form == EForm::kBranch ? ERelocKind::kThumbB11 : ERelocKind::kThumbBL);
+      return true;
+    case EForm::kRdLabel:
+      if (n != 2 || !IsLow(ops[0]) || ops[1].type != EOperand::kLabel) { return false; }
+      v |= ops[0].value << 8;
+      SetLabel(encoded, ops[1], ERelocKind::kThumbPcRel8);
+      return true;
+    case EForm::kRegList: {
+      std::uint32_t list;
+      if (!MakeRegList(ops, n, form.param, list)) { return false; }
+      v |= list;
+      return true;
+    }
+    case EForm::kRnRegList: {
+      std::uint32_t list;
+      if (n < 2 || !IsLow(ops[0]) || !MakeRegList(ops + 1, n - 1, 0, list)) { return false; }
+      v |= ops[0].value << 8 | list;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}
+
+namespace a2 {
+
+EncodedInstruction EncodeThumb(const Instruction& inst) {
+  auto name = inst.func.Str();
+  auto first = FindForm(name);
+  if (first == gFormCount) {
+    throw ParseException(EParseErrorCode::kUnknownInstruction);
+  }
+
+  if (inst.args.size() > kMaxOperands) {
+    throw ParseException(EParseErrorCode::kInvalidOperand);
+  }
+  Operand ops[kMaxOperands];
+  for (std::size_t i = 0; i < inst.args.size(); i++) {
+    ops[i] = ToOperand(inst.args[i]);
+  }
+
+  EncodedInstruction encoded{};
+  encoded.bits.resolved = true;
+  for (auto i = first; i < gFormCount && gForms[i].name == gForms[first].name; i++) {
+    if (Match(gForms[i], ops, inst.args.size(), encoded)) {
+      encoded.bits.size = gForms[i].opcode > 0xffff ? 4 : 2;
+      return encoded;
+    }
+    encoded.target = {};
+  }
+
+  throw ParseException(EParseErrorCode::kInvalidOperand);
+}
+
+}
+
+namespace a2test {
+
+using namespace a2;
+
+namespace {
+
+Instruction MakeInstruction(const char* func, InstructionArgs args) {
+  Instruction inst;
+  inst.func = Intern(func);
+  inst.args = std::move(args);
+  return inst;
+}
+
+ArithSeries Reg(const char* name) {
+  Refed refed(RegisterNumber(name), ERefedOp::kNone);
+  refed.type = ERefedType::kReg;
+  refed.ref = Intern(name);
+  return {refed};
+}
+
+ArithSeries Imm(std::size_t num) { return {Refed(num, ERefedOp::kNone)}; }
+
+ArithSeries Label(const char* name, std::size_t addend = 0) {
+  ArithSeries series = {Refed(std::string("@") + name, ERefedOp::kNone)};
+  if (addend != 0) {
+    series.emplace_back(addend, ERefedOp::kAdd);
+  }
+  return series;
+}
+
+void TestEncoding(std::size_t id, unsigned int expected, const Instruction& inst) {
+  std::stringstream ss;
+  PutTestId(id, ss);
+  try {
+    auto encoded = EncodeThumb(inst);
+    if (AssertEqual("encoding", expected, encoded.bits.value, ss)) {
+      std::cout << ".";
+      return;
+    }
+  } catch (const ParseException& pe) {
+    UnexpectedException(ss);
+  }
+  std::cout << std::endl << ss.str();
+}
+
+void TestEncodingError(std::size_t id, EParseErrorCode expected, const Instruction& inst) {
+  std::stringstream ss;
+  PutTestId(id, ss);
+  try {
+    EncodeThumb(inst);
+    ExceptionNotThrown(gEParseErrorCodeToStr[expected], ss);
+  } catch (const ParseException& pe) {
+    if (AssertEqual("exception", gEParseErrorCodeToStr[expected], gEParseErrorCodeToStr[pe.Code], ss)) {
+      std::cout << ".";
+      return;
+    }
+  }
+  std::cout << std::endl << ss.str();
+}
+
+// links the instructions from 0 and returns their values
+std::vector<unsigned int> LinkInstructions(const std::vector<Instruction>& insts, const std::vector<Symbol>& tags) {
+  Linker linker;
+  for (std::size_t i = 0; i < insts.size(); i++) {
+    auto encoded = EncodeThumb(insts[i]);
+    encoded.bits.tag = tags[i];
+    auto piece = linker.Add(encoded.bits);
+    if (!encoded.target.Empty()) {
+      linker.Relocate(piece, encoded.target, ERefedOp::kNone, encoded.kind, encoded.addend);
+    }
+  }
+  linker.Link(0);
+
+  std::vector<unsigned int> values;
+  for (std::uint32_t i = 0; i < linker.Count(); i++) {
+    values.push_back(linker.Value(i));
+  }
+  return values;
+}
+
+}
+
+void TestThumb() {
+  PutTestHeader("Thumb", std::cout);
+
+  TestEncoding(1, 0xbf00, MakeInstruction("NOP", {}));
+  TestEncoding(2, 0xbf00, MakeInstruction("nop", {}));
+  TestEncoding(3, 0x2142, MakeInstruction("MOVS", {Reg("r1"), Imm(0x42)}));
+  TestEncoding(4, 0x0008, MakeInstruction("MOVS", {Reg("r0"), Reg("r1")}));
+  TestEncoding(5, 0x4685, MakeInstruction("MOV", {Reg("sp"), Reg("r0")}));
+  TestEncoding(6, 0x18d1, MakeInstruction("ADDS", {Reg("r1"), Reg("r2"), Reg("r3")}));
+  TestEncoding(7, 0x1dd1, MakeInstruction("ADDS", {Reg("r1"), Reg("r2"), Imm(7)}));
+  TestEncoding(8, 0x3108, MakeInstruction("ADDS", {Reg("r1"), Imm(8)}));
+  TestEncoding(9, 0xb004, MakeInstruction("ADD", {Reg("sp"), Imm(16)}));
+  TestEncoding(10, 0xb084, MakeInstruction("SUB", {Reg("sp"), Imm(16)}));
+  TestEncoding(11, 0x6848, MakeInstruction("LDR", {Reg("r0"), Reg("r1"), Imm(4)}));
+  TestEncoding(12, 0x6808, MakeInstruction("LDR", {Reg("r0"), Reg("r1")}));
+  TestEncoding(13, 0x9a01, MakeInstruction("LDR", {Reg("r2"), Reg("sp"), Imm(4)}));
+  TestEncoding(14, 0x5888, MakeInstruction("LDR", {Reg("r0"), Reg("r1"), Reg("r2")}));
+  TestEncoding(15, 0x8048, MakeInstruction("STRH", {Reg("r0"), Reg("r1"), Imm(2)}));
+  TestEncoding(16, 0xb510, MakeInstruction("PUSH", {Reg("r4"), Reg("lr")}));
+  TestEncoding(17, 0xbd10, MakeInstruction("POP", {Reg("r4"), Reg("pc")}));
+  TestEncoding(18, 0xc906, MakeInstruction("LDM", {Reg("r1"), Reg("r1"), Reg("r2")}));
+  TestEncoding(19, 0x4770, MakeInstruction("BX", {Reg("lr")}));
+  TestEncoding(20, 0x0fc8, MakeInstruction("LSRS", {Reg("r0"), Reg("r1"), Imm(31)}));
+  TestEncoding(21, 0x1008, MakeInstruction("ASRS", {Reg("r0"), Reg("r1"), Imm(32)}));
+  TestEncoding(22, 0x45d8, MakeInstruction("CMP", {Reg("r8"), Reg("r11")}));
+  TestEncoding(23, 0x8f5ff3bf, MakeInstruction("DMB", {}));
+  TestEncoding(24, 0xdf01, MakeInstruction("SVC", {Imm(1)}));
+  TestEncodingError(25, EParseErrorCode::kUnknownInstruction, MakeInstruction("JUMP", {}));
+  TestEncodingError(26, EParseErrorCode::kInvalidOperand, MakeInstruction("MOVS", {Reg("r0"), Imm(256)}));
+  TestEncodingError(27, EParseErrorCode::kInvalidOperand, MakeInstruction("ADDS", {Reg("r8"), Imm(1)}));
+  TestEncodingError(28, EParseErrorCode::kInvalidOperand, MakeInstruction("LDR", {Reg("r0"), Reg("r1"), Imm(2)}));
+  TestEncodingError(29, EParseErrorCode::kInvalidOperand, MakeInstruction("PUSH", {Reg("r4"), Reg("pc")}));
+  TestEncodingError(30, EParseErrorCode::kInvalidOperand, MakeInstruction("NOP", {Imm(1)}));
+
+  {
+    // loop: NOP / B(loop) / BNE(loop) / BL(far) / LDR(r0, lit) / ADR(r1, lit + 4) / NOP / lit: NOP / far: NOP
+    std::stringstream ss;
+    PutTestId(31, ss);
+    std::vector<Instruction> insts = {
+      MakeInstruction("NOP", {}),
+      MakeInstruction("B", {Label("loop")}),
+      MakeInstruction("BNE", {Label("loop")}),
+      MakeInstruction("BL", {Label("far")}),
+      MakeInstruction("LDR", {Reg("r0"), Label("lit")}),
+      MakeInstruction("ADR", {Reg("r1"), Label("lit", 4)}),
+      MakeInstruction("NOP", {}),
+      MakeInstruction("NOP", {}),
+      MakeInstruction("NOP", {}),
+    };
+    std::vector<Symbol> tags = {Intern("loop"), {}, {}, {}, {}, {}, {}, Intern("lit"), Intern("far")};
+    std::vector<unsigned int> expected = {0xbf00, 0xe7fd, 0xd1fc, 0xf804f000, 0x4801, 0xa101, 0xbf00, 0xbf00, 0xbf00};
+    try {
+      if (AssertEqual("values", expected, LinkInstructions(insts, tags), ss)) {
+        std::cout << ".";
+      } else {
+        std::cout << std::endl << ss.str();
+      }
+    } catch (const ParseException& pe) {
+      UnexpectedException(ss);
+      std::cout << std::endl << ss.str();
+    }
+  }
+
+  {
+    std::stringstream ss;
+    PutTestId(32, ss);
+    std::vector<Instruction> insts(200, MakeInstruction("NOP", {}));
+    insts.push_back(MakeInstruction("BEQ", {Label("start")}));
+    std::vector<Symbol> tags(insts.size());
+    tags[0] = Intern("start");
+    try {
+      LinkInstructions(insts, tags);
+      ExceptionNotThrown(gEParseErrorCodeToStr[EParseErrorCode::kOutOfRange], ss);
+      std::cout << std::endl << ss.str();
+    } catch (const ParseException& pe) {
+      if (AssertEqual("exception", gEParseErrorCodeToStr[EParseErrorCode::kOutOfRange], gEParseErrorCodeToStr[pe.Code], ss)) {
+        std::cout << ".";
+      } else {
+        std::cout << std::endl << ss.str();
+      }
+    }
+  }
+
+  // ADD(rd, sp) adds sp to rd, only with an offset is it rd = sp + imm
+  TestEncoding(33, 0xa801, MakeInstruction("ADD", {Reg("r0"), Reg("sp"), Imm(4)}));
+  TestEncoding(34, 0x4468, MakeInstruction("ADD", {Reg("r0"), Reg("sp")}));
+  TestEncoding(35, 0x9800, MakeInstruction("LDR", {Reg("r0"), Reg("sp")}));
+
+  std::cout << std::endl;
+}
+
+}
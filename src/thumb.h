@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+#include "linker.h"
+#include "types.h"
+
+namespace a2 {
+
+struct EncodedInstruction {
+  Bits bits;                              // opcode with every operand that is known before linking
+  Symbol target;                          // tag the instruction refers to, empty if none
+  ERelocKind kind = ERelocKind::kAbs32;
+  std::int32_t addend = 0;
+};
+
+// Encodes one Cortex-M0 (ARMv6-M Thumb) instruction from its folded operands. Registers are
+// r0-r15, sp, lr and pc; immediates are plain numbers; a branch or literal target is a tag.
+// Operands follow the mnemonic in assembler order with the brackets and '#' dropped, e.g.
+// LDR(r0, r1, 4), PUSH(r4, lr), ADD(sp, 16). Throws ParseException with kUnknownInstruction
+// or kInvalidOperand.
+EncodedInstruction EncodeThumb(const Instruction& inst);
+
+}
+
+namespace a2test {
+void TestThumb();
+}
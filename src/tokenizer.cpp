@@ -1,6 +1,6 @@
 #include "tokenizer.h"
 
-#include <regex>
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -8,190 +8,330 @@
 #include "exception.h"
 #include "testutil.h"
 
-#define RGX_INDENT "( *)"
-#define RGX_BLANK " *"
-
-#define RGX_NAME "[a-zA-Z_]\\w*"
-
-#define RGX_NAME_CP "(" RGX_NAME ")"          // letter or '_' at pos0, letter or '_' or num at pos1+
-#define RGX_INT "([0-9]+(?![xX]))"            // negative lookahead to avoid catching '0' of 0x123
-#define RGX_HEX "(?:0[xX]([0-9a-fA-F]+))"
-#define RGX_NUM "(?:" RGX_INT "|" RGX_HEX ")"
-
-
-#define RGX_ADDR_REF "(@\\w+)"
-#define RGX_CONST_REF "(" RGX_NAME "(?:\\." RGX_NAME ")*)"
-#define RGX_ALL_REF "(?:" RGX_ADDR_REF "|" RGX_CONST_REF "|" RGX_NUM ")"
-
-#define RGX_ALL_REF_WITH_BLANK RGX_BLANK RGX_ALL_REF RGX_BLANK
-
-#define RGX_ARITH_OP "(\\+|-)"
-#define RGX_ARITH_OP_THEN_ALL_REF RGX_ARITH_OP RGX_ALL_REF_WITH_BLANK
-
-#define RGX_ARITH_SERIES RGX_ALL_REF_WITH_BLANK "(:?" RGX_ARITH_OP RGX_ALL_REF_WITH_BLANK ")*"
-
-// named constant
-#define RGX_NC_NAME "((?:\\.?" RGX_NAME "|\\.\\*))"        // can start with '.', be just ".*", or plain name
-
-// instruction
-#define RGX_INST_NAME "([a-zA-Z]+)"
+// Grammar accepted by the scanner below (single pass, no backtracking):
+//
+//   indent        ' '*
+//   blank         ' '*
+//   name          [a-zA-Z_]\w*
+//   num           [0-9]+ (not followed by [xX]) | 0[xX][0-9a-fA-F]+
+//   addr_ref      '@' \w+
+//   const_ref     name ('.' name)*
+//   ref           addr_ref | const_ref | num
+//   arith_series  blank ref blank (('+' | '-') blank ref blank)*
+//   nc_name       '.'? name | ".*"                  // can start with '.', be just ".*", or plain name
+//   inst_name     [a-zA-Z]+
+//
+//   named constant   indent nc_name blank ':' blank num blank
+//   named ref        indent name ':' arith_series
+//   instruction      indent inst_name ('(' arith_series (',' arith_series)* ')')? blank
+//   named tag        indent name ':' blank
  
 namespace {
 
-std::regex gRgxNamedConstant(RGX_INDENT RGX_NC_NAME RGX_BLANK ":" RGX_BLANK RGX_NUM RGX_BLANK);
+using namespace a2;
 
-std::regex gRgxNamedRef(RGX_INDENT RGX_NAME_CP ":(" RGX_ARITH_SERIES ")");
+enum ECharClass : unsigned char {
+  kAlpha = 1 << 0,
+  kDigit = 1 << 1,
+  kHexLetter = 1 << 2,
+  kUnderscore = 1 << 3,
+  kBlank = 1 << 4,
+
+  kNameHead = kAlpha | kUnderscore,
+  kWord = kAlpha | kDigit | kUnderscore,
+  kHexDigit = kDigit | kHexLetter
+};
+
+struct CharClassTable {
+  unsigned char bits[256];
+};
+
+constexpr CharClassTable MakeCharClassTable() {
+  CharClassTable table{};
+  for (int c = 0; c < 256; c++) {
+    unsigned char bits = 0;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) { bits |= kAlpha; }
+    if ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) { bits |= kHexLetter; }
+    if (c >= '0' && c <= '9') { bits |= kDigit; }
+    if (c == '_') { bits |= kUnderscore; }
+    if (c == ' ') { bits |= kBlank; }
+    table.bits[c] = bits;
+  }
+  return table;
+}
 
-std::regex gRgxInst(RGX_INDENT RGX_INST_NAME "(?:\\((" RGX_ARITH_SERIES "(?:," RGX_ARITH_SERIES  ")*" ")\\))?" RGX_BLANK);
+// built by the compiler, nothing to initialize at startup
+constexpr CharClassTable gCharClass = MakeCharClassTable();
 
-std::regex gRgxNamedTag(RGX_INDENT RGX_NAME_CP ":" RGX_BLANK);
+template<unsigned char kClass>
+constexpr bool Is(char c) { return (gCharClass.bits[static_cast<unsigned char>(c)] & kClass) != 0; }
 
-std::regex gRgxAllRef(RGX_ALL_REF);
-std::regex gRgxArithOpThenAllRef(RGX_ARITH_OP_THEN_ALL_REF);
-std::regex gRgxArithSeries(RGX_ARITH_SERIES);
+static_assert(Is<kNameHead>('_') && !Is<kNameHead>('0') && Is<kWord>('0'), "char class table");
+static_assert(Is<kHexDigit>('F') && !Is<kHexDigit>('g') && !Is<kWord>('.'), "char class table");
 
-std::regex gRgxConstRef(RGX_CONST_REF);
-std::regex gRgxName(RGX_NAME);
+std::size_t HexDigitValue(char c) {
+  if (Is<kDigit>(c)) { return c - '0'; }
+  return (c | 0x20) - 'a' + 10;
+}
 
-using namespace a2;
+ERefedOp ParseArithOp(char c) {
+  switch (c) {
+    case '+': return ERefedOp::kAdd;
+    case '-': return ERefedOp::kSubtract;
+  }
 
-std::size_t CountIndent(const std::string& s) {
-  if ((s.length() % INDENT_UNIT) > 0) {
+  throw ParseException(EParseErrorCode::kUnexpectedArithOp);
+}
+
+void Expect(bool matched) {
+  if (!matched) {
+    throw ParseException(EParseErrorCode::kRegexError);
+  }
+}
+
+std::size_t CountIndent(std::size_t len) {
+  if ((len % INDENT_UNIT) > 0) {
     throw ParseException(EParseErrorCode::kIndentCount);
   }
-  return s.length() / INDENT_UNIT; 
+  return len / INDENT_UNIT; 
 }
 
-template<typename T, typename F>
-std::vector<T> TokenizeRepeatedRgx(const std::string& s, std::regex& rgx, F f) {
-  std::vector<T> repeats;
-  std::string temp = s;
-  std::smatch match;
-  while (std::regex_search(temp, match, rgx)) {
-    repeats.push_back(f(match));
-    temp = match.suffix();
+// Each Scan* method either consumes a complete production and returns true, or returns false.
+// A false return leaves the position unspecified; callers give up on the whole line in that case.
+class Scanner {
+public:
+  Scanner(std::string_view s) : s_(s), pos_(0) {}
+
+  bool AtEnd() const { return pos_ == s_.length(); }
+  char Peek(std::size_t ahead = 0) const { return pos_ + ahead < s_.length() ? s_[pos_ + ahead] : '\0'; }
+
+  bool Accept(char c);
+  std::size_t ScanBlank();
+  bool ScanName(std::string_view& name);
+  bool ScanName(Symbol& name);
+  bool ScanConstantName(std::string_view& name);
+  bool ScanInstName(Symbol& name);
+  bool ScanNum(std::size_t& num);
+  bool ScanRef(ERefedOp op, ArithSeries& refs);
+  bool ScanArithSeries(ArithSeries& refs);
+
+private:
+  template<unsigned char kClass>
+  std::size_t ScanWhile();
+
+  bool ScanConstRef();
+
+  std::string_view s_;
+  std::size_t pos_;
+};
+
+bool Scanner::Accept(char c) {
+  if (Peek() == c) {
+    pos_++;
+    return true;
   }
+  return false;
+}
 
-  return repeats;
+template<unsigned char kClass>
+std::size_t Scanner::ScanWhile() {
+  auto from = pos_;
+  while (pos_ < s_.length() && Is<kClass>(s_[pos_])) { pos_++; }
+  return pos_ - from;
 }
 
+std::size_t Scanner::ScanBlank() {
+  return ScanWhile<kBlank>();
 }
 
-namespace a2 {
+bool Scanner::ScanName(std::string_view& name) {
+  auto from = pos_;
+  if (!Is<kNameHead>(Peek())) { return false; }
+  ScanWhile<kWord>();
+  name = s_.substr(from, pos_ - from);
+  return true;
+}
 
-ERefedOp ParseArithOp(char c) {
-  switch (c) {
-    case '+': return ERefedOp::kAdd;
-    case '-': return ERefedOp::kSubtract;
+bool Scanner::ScanName(Symbol& name) {
+  std::string_view s;
+  if (!ScanName(s)) { return false; }
+  name = Intern(s);
+  return true;
+}
+
+bool Scanner::ScanConstantName(std::string_view& name) {
+  auto from = pos_;
+  if (!(Accept('.') && Accept('*'))) {
+    if (!Is<kNameHead>(Peek())) { return false; }
+    ScanWhile<kWord>();
   }
+  name = s_.substr(from, pos_ - from);
+  return true;
+}
 
-  throw ParseException(EParseErrorCode::kUnexpectedArithOp);
+bool Scanner::ScanInstName(Symbol& name) {
+  auto from = pos_;
+  if (ScanWhile<kAlpha>() == 0) { return false; }
+  name = Intern(s_.substr(from, pos_ - from));
+  return true;
 }
 
-NamedConstant TokenizeNamedConstant(const std::string& s) {
-  std::smatch match;
-  if (std::regex_match(s, match, gRgxNamedConstant)) {
-    NamedConstant named_constant;
-    named_constant.indent = CountIndent(match[1].str());
-    named_constant.name = match[2].str();
-    if (match[3].length() > 0) {
-      named_constant.value = strtoul(match[3].str().c_str(), nullptr, 10);
-    } else {
-      named_constant.value = strtoul(match[4].str().c_str(), nullptr, 16);
+// throws kOutOfRange for a number that does not fit in 64 bits
+bool Scanner::ScanNum(std::size_t& num) {
+  if (!Is<kDigit>(Peek())) { return false; }
+
+  num = 0;
+  if (Peek() == '0' && (Peek(1) == 'x' || Peek(1) == 'X')) {
+    pos_ += 2;
+    auto from = pos_;
+    if (ScanWhile<kHexDigit>() == 0) { return false; }
+    for (auto i = from; i < pos_; i++) {
+      if (num >> 60 != 0) {
+        throw ParseException(EParseErrorCode::kOutOfRange);
+      }
+      num = (num << 4) | HexDigitValue(s_[i]);
     }
-    return named_constant;
-  } else {
-    throw ParseException(EParseErrorCode::kRegexError);
+    return true;
   }
+
+  auto from = pos_;
+  ScanWhile<kDigit>();
+  for (auto i = from; i < pos_; i++) {
+    auto digit = static_cast<std::size_t>(s_[i] - '0');
+    if (num > (SIZE_MAX - digit) / 10) {
+      throw ParseException(EParseErrorCode::kOutOfRange);
+    }
+    num = num * 10 + digit;
+  }
+  return Peek() != 'x' && Peek() != 'X';   // keeps "0" of "0x" from being read as a decimal
 }
 
-void AppendRefed(const std::smatch& match, int index, ERefedOp op, std::vector<Refed>& refs) {
-  if (match[index].length() > 0) {
-    refs.emplace_back(Refed {match[index].str(), op});
-  } else if (match[index + 1].length() > 0) {
-    refs.emplace_back(Refed {match[index + 1], op});
-  } else if (match[index + 2].length() > 0) {
-    refs.emplace_back(Refed {std::stoul(match[index + 2]), op});
-  } else if (match[index + 3].length() > 0) {
-    refs.emplace_back(Refed {std::stoul(match[index + 3], 0, 16), op});
+bool Scanner::ScanConstRef() {
+  if (!Is<kNameHead>(Peek())) { return false; }
+  ScanWhile<kWord>();
+  while (Peek() == '.' && Is<kNameHead>(Peek(1))) {
+    pos_++;
+    ScanWhile<kWord>();
   }
+  return true;
 }
 
-Refed CreateRefed(const std::smatch& match, int index, ERefedOp op = ERefedOp::kNone) {
-  if (match[index].length() > 0) {
-    return {match[index].str(), op};
-  } else if (match[index + 1].length() > 0) {
-    return {match[index + 1], op};
-  } else if (match[index + 2].length() > 0) {
-    return {std::stoul(match[index + 2]), op};
-  } else if (match[index + 3].length() > 0) {
-    return {std::stoul(match[index + 3], 0, 16), op};
+bool Scanner::ScanRef(ERefedOp op, ArithSeries& refs) {
+  auto from = pos_;
+  if (Accept('@')) {
+    if (ScanWhile<kWord>() == 0) { return false; }
+    refs.emplace_back(Refed {s_.substr(from, pos_ - from), op});
+    return true;
+  } else if (ScanConstRef()) {
+    refs.emplace_back(Refed {s_.substr(from, pos_ - from), op});
+    return true;
+  } 
+
+  std::size_t num = 0;
+  if (ScanNum(num)) {
+    refs.emplace_back(Refed {num, op});
+    return true;
   }
+  return false;
+}
 
-  throw ParseException(EParseErrorCode::kUnexpected);
+bool Scanner::ScanArithSeries(ArithSeries& refs) {
+  ScanBlank();
+  if (!ScanRef(ERefedOp::kNone, refs)) { return false; }
+  ScanBlank();
+
+  while (Peek() == '+' || Peek() == '-') {
+    auto op = ParseArithOp(Peek());
+    pos_++;
+    ScanBlank();
+    if (!ScanRef(op, refs)) { return false; }
+    ScanBlank();
+  }
+  return true;
 }
 
-std::vector<Refed> TokenizeArithSeries(const std::string& s) {
-  std::vector<Refed> refed;
-  std::smatch match_first_ref; // does not start with arith op, needs a different regex obj
+}
 
-  if (std::regex_search(s, match_first_ref, gRgxAllRef)) {
-    refed.push_back(CreateRefed(match_first_ref, 1));
-    auto more_args = TokenizeRepeatedRgx<Refed>(match_first_ref.suffix(), gRgxArithOpThenAllRef, [](auto& match_more_args) {
-       return CreateRefed(match_more_args, 2, ParseArithOp(match_more_args[1].str()[0]));
-    });
-    refed.insert(refed.end(), more_args.begin(), more_args.end());
-    return refed;
-  } else {
-    throw ParseException(EParseErrorCode::kUnexpected);
-  }
+namespace a2 {
 
-  return refed;
+NamedConstant TokenizeNamedConstant(const SourceLine& line) {
+  Scanner scanner(line.text.substr(line.indent));
+  NamedConstant named_constant;
+  std::size_t value = 0;
+
+  Expect(scanner.ScanConstantName(named_constant.name));
+  scanner.ScanBlank();
+  Expect(scanner.Accept(':'));
+  scanner.ScanBlank();
+  Expect(scanner.ScanNum(value));
+  scanner.ScanBlank();
+  Expect(scanner.AtEnd());
+
+  named_constant.indent = CountIndent(line.indent);
+  named_constant.value = value;
+  return named_constant;
 }
 
-NamedRef TokenizeNamedRef(const std::string& s) {
-  std::smatch match;
-  if (std::regex_match(s, match, gRgxNamedRef)) {
-    NamedRef named_ref;
-    named_ref.indent = CountIndent(match[1].str());
-    named_ref.name = match[2];
-    named_ref.value = TokenizeArithSeries(match[3].str());
-    return named_ref;
-  } else {
-    throw ParseException(EParseErrorCode::kRegexError);
-  }
+NamedRef TokenizeNamedRef(const SourceLine& line) {
+  Scanner scanner(line.text.substr(line.indent));
+  NamedRef named_ref;
+
+  Expect(scanner.ScanName(named_ref.name));
+  Expect(scanner.Accept(':'));
+  Expect(scanner.ScanArithSeries(named_ref.value));
+  Expect(scanner.AtEnd());
+
+  named_ref.indent = CountIndent(line.indent);
+  return named_ref;
 }
 
-Instruction TokenizeInstruction(const std::string& s) {
-  std::smatch match;
-  if (std::regex_match(s, match, gRgxInst)) {
-    Instruction inst;
-    inst.indent = CountIndent(match[1].str());
-    inst.func = match[2];
-    if (match[3].length() > 0) {
-      inst.args = TokenizeRepeatedRgx<std::vector<Refed>>(match[3], gRgxArithSeries, [](auto& match_arith_series) {
-        return TokenizeArithSeries(match_arith_series[0].str());
-      });
-    }
-    return inst;
-  } else {
-    throw ParseException(EParseErrorCode::kRegexError);
+Instruction TokenizeInstruction(const SourceLine& line) {
+  Scanner scanner(line.text.substr(line.indent));
+  Instruction inst;
+
+  Expect(scanner.ScanInstName(inst.func));
+
+  if (scanner.Accept('(')) {
+    do {
+      inst.args.emplace_back();
+      Expect(scanner.ScanArithSeries(inst.args.back()));
+    } while (scanner.Accept(','));
+    Expect(scanner.Accept(')'));
   }
+
+  scanner.ScanBlank();
+  Expect(scanner.AtEnd());
+
+  inst.indent = CountIndent(line.indent);
+  return inst;
 }
 
-std::tuple<bool, std::string> TryTokenizeNamedTag(const std::string& s) {
-  std::smatch match;
-  if (std::regex_match(s, match, gRgxNamedTag)) {
-    return {true, match[2].str()};
+std::tuple<bool, Symbol> TryTokenizeNamedTag(const SourceLine& line) {
+  Scanner scanner(line.text.substr(line.indent));
+  Symbol tag;
+
+  if (scanner.ScanName(tag) && scanner.Accept(':')) {
+    scanner.ScanBlank();
+    if (scanner.AtEnd()) {
+      return {true, tag};
+    }
   }
 
   return {false,{}};
 }
 
-std::vector<std::string> TokenizeConstRef(const std::string& s) {
-  std::smatch match;
-  if (std::regex_match(s, match, gRgxConstRef)) {
-    return TokenizeRepeatedRgx<std::string>(s, gRgxName, [](auto& match_level) { return match_level[0]; });
+std::vector<std::string_view> TokenizeConstRef(std::string_view s) {
+  Scanner scanner(s);
+  std::vector<std::string_view> levels(1);
+
+  while (scanner.ScanName(levels.back())) {
+    if (scanner.AtEnd()) {
+      return levels;
+    }
+    if (!scanner.Accept('.')) {
+      break;
+    }
+    levels.emplace_back();
   }
 
   return {};
@@ -204,6 +344,13 @@ namespace a2test {
 
 using namespace a2;
 using CSR = const std::string&;
+using SV = std::string_view;
+
+// s as a LineIndex hands it over, the inputs below hold no tabs
+SourceLine Line(CSR s) {
+  auto indent = s.find_first_not_of(' ');
+  return {s, indent == std::string::npos ? s.length() : indent};
+}
 
 template<typename F>
 void Test(int id, EParseErrorCode exp_error, std::ostream& out, F f) {
@@ -236,7 +383,7 @@ bool VerifyRefed(std::size_t ref_index, const Refed& expected, const Refed& actu
      AssertEqual((s_ref + " num").c_str(), expected.num, actual.num, out));
 }
 
-bool VerifyRefed(const std::vector<Refed>& expected, const std::vector<Refed>& actual, std::ostream& out) {
+bool VerifyRefed(const std::vector<Refed>& expected, const ArithSeries& actual, std::ostream& out) {
   if (!AssertEqual("arg_ct", expected.size(), actual.size(), out)) { return false; }
   for (std::size_t i = 0; i < expected.size(); i++) {
     if (!VerifyRefed(i, expected[i], actual[i], out)) { return false; }
@@ -244,7 +391,7 @@ bool VerifyRefed(const std::vector<Refed>& expected, const std::vector<Refed>& a
   return true;
 }
 
-bool VerifyRefed(const std::vector<std::vector<Refed>>& expected, const std::vector<std::vector<Refed>>& actual, std::ostream& out) {
+bool VerifyRefed(const std::vector<std::vector<Refed>>& expected, const InstructionArgs& actual, std::ostream& out) {
   if (!AssertEqual("arg_list_ct", expected.size(), actual.size(), out)) { return false; }
   for (std::size_t i = 0; i < expected.size(); i++) {
     if (!VerifyRefed(expected[i], actual[i], out)) { return false; }
@@ -255,10 +402,10 @@ bool VerifyRefed(const std::vector<std::vector<Refed>>& expected, const std::vec
 // ----------------------------------------------------------------------------
 // Test TokenizeNamedConstant
 // ----------------------------------------------------------------------------
-void TestTnc(int id, CSR s, EParseErrorCode exp_error, std::size_t exp_indent, CSR exp_name, unsigned int exp_value) {
+void TestTnc(int id, CSR s, EParseErrorCode exp_error, std::size_t exp_indent, SV exp_name, std::size_t exp_value) {
 
   Test(id, exp_error, std::cout, [&](std::ostream& out) {
-    auto r = TokenizeNamedConstant(s);
+    auto r = TokenizeNamedConstant(Line(s));
     if (exp_error == EParseErrorCode::kSuccess) {
       return AssertEqual("name", exp_name, r.name, out) && 
           AssertEqual("value", exp_value, r.value, out) && 
@@ -276,12 +423,12 @@ void TestTnc(int id, CSR s, EParseErrorCode exp_error) {
 // ----------------------------------------------------------------------------
 // Test TokenizeNamedRef
 // ----------------------------------------------------------------------------
-void TestTnr(int id, CSR s, EParseErrorCode exp_error, std::size_t exp_indent, CSR exp_name, const std::vector<Refed>& expected_args) {
+void TestTnr(int id, CSR s, EParseErrorCode exp_error, std::size_t exp_indent, SV exp_name, const std::vector<Refed>& expected_args) {
   Test(id, exp_error, std::cout, [&](std::ostream& out) {
-    auto r = TokenizeNamedRef(s);
+    auto r = TokenizeNamedRef(Line(s));
     if (exp_error == EParseErrorCode::kSuccess) {
       return AssertEqual("indent", exp_indent, r.indent, out) &&
-        AssertEqual("name", exp_name, r.name, out) &&
+        AssertEqual("name", exp_name, r.name.Str(), out) &&
         VerifyRefed(expected_args, r.value, out);
     }
 
@@ -297,13 +444,13 @@ void TestTnr(int id, CSR s, EParseErrorCode exp_error) {
 // ----------------------------------------------------------------------------
 // Test TokenizeInstruction
 // ----------------------------------------------------------------------------
-void TestTni(int id, CSR s, EParseErrorCode exp_error, std::size_t exp_indent, CSR exp_func, const std::vector<std::vector<Refed>>& exp_args) {
+void TestTni(int id, CSR s, EParseErrorCode exp_error, std::size_t exp_indent, SV exp_func, const std::vector<std::vector<Refed>>& exp_args) {
   Test(id, exp_error, std::cout, [&](std::ostream& out) {
-    auto inst = TokenizeInstruction(s);
+    auto inst = TokenizeInstruction(Line(s));
     if (exp_error == EParseErrorCode::kSuccess) {
       return 
         AssertEqual("indent", exp_indent, inst.indent, out) && 
-        AssertEqual("func", exp_func, inst.func, out) &&
+        AssertEqual("func", exp_func, inst.func.Str(), out) &&
         VerifyRefed(exp_args, inst.args, out);
     }
 
@@ -312,7 +459,7 @@ void TestTni(int id, CSR s, EParseErrorCode exp_error, std::size_t exp_indent, C
   });
 }
 
-void TestTni(int id, CSR s, EParseErrorCode exp_error, std::size_t exp_indent, CSR exp_func) {
+void TestTni(int id, CSR s, EParseErrorCode exp_error, std::size_t exp_indent, SV exp_func) {
   TestTni(id, s, exp_error, exp_indent, exp_func, {});
 }
 
@@ -323,20 +470,20 @@ void TestTni(int id, CSR s, EParseErrorCode exp_error) {
 // ----------------------------------------------------------------------------
 // Test TryTokenizeNamedTag
 // ----------------------------------------------------------------------------
-void TestTtnt(int id, CSR s, bool exp_result, CSR exp_tag) {
+void TestTtnt(int id, CSR s, bool exp_result, SV exp_tag) {
   Test(id, EParseErrorCode::kSuccess, std::cout, [&](std::ostream& out) {
     bool result = false;
-    std::string tag;
-    std::tie(result, tag) = TryTokenizeNamedTag(s);
+    Symbol tag;
+    std::tie(result, tag) = TryTokenizeNamedTag(Line(s));
     return AssertEqual("result", exp_result, result, out) &&
-           AssertEqual("tag", exp_tag, tag, out);
+           AssertEqual("tag", exp_tag, tag.Str(), out);
   });
 }
 
 // ----------------------------------------------------------------------------
 // Test TokenizeConstRef
 // ----------------------------------------------------------------------------
-void TestTcr(int id, CSR s, EParseErrorCode exp_error, const std::vector<std::string>& exp_const_ref) {
+void TestTcr(int id, CSR s, EParseErrorCode exp_error, const std::vector<SV>& exp_const_ref) {
   Test(id, exp_error, std::cout, [&](std::ostream& out) {
       auto cf = TokenizeConstRef(s);
       return AssertEqual("const ref", exp_const_ref, cf, out);
@@ -355,11 +502,18 @@ void TestTokenizer() {
   TestTnc(8, ".iopaen: 0x1", EParseErrorCode::kSuccess, 0, ".iopaen", 0x1);
   TestTnc(9, ".*: 0x3", EParseErrorCode::kSuccess, 0, ".*", 0x3);
   TestTnc(10, "a_b:0x200", EParseErrorCode::kSuccess, 0, "a_b", 0x200);
+  TestTnc(11, "big:0x100000010", EParseErrorCode::kSuccess, 0, "big", 0x100000010);
+  TestTnc(12, "max:18446744073709551615", EParseErrorCode::kSuccess, 0, "max", SIZE_MAX);
+  TestTnc(13, "hex:0x0000ffffffffffffffff", EParseErrorCode::kSuccess, 0, "hex", SIZE_MAX);
 
   TestTnc(20, "c0", EParseErrorCode::kRegexError);
   TestTnc(21, "c.", EParseErrorCode::kRegexError);   // '.' only allowed at the beginning of name
   TestTnc(22, ".**", EParseErrorCode::kRegexError);   // '.*' is the only valid usage of '*'
+  TestTnc(23, "c:0x", EParseErrorCode::kRegexError);  // hex prefix without digits
+  TestTnc(24, "c:10x5", EParseErrorCode::kRegexError);
   TestTnc(25, " c:0", EParseErrorCode::kIndentCount);
+  TestTnc(26, "c:0x10000000000000010", EParseErrorCode::kOutOfRange);
+  TestTnc(27, "c:18446744073709551616", EParseErrorCode::kOutOfRange);
   std::cout << std::endl;
 
   PutTestHeader("TokenizeNamedRef", std::cout);
@@ -386,6 +540,8 @@ void TestTokenizer() {
   TestTnr(22, "r:ext@", EParseErrorCode::kRegexError);
   TestTnr(23, "r:a..b", EParseErrorCode::kRegexError);
   TestTnr(24, "r:.a", EParseErrorCode::kRegexError);
+  TestTnr(25, "r:a.", EParseErrorCode::kRegexError);
+  TestTnr(26, "r:@a.b", EParseErrorCode::kRegexError);
   TestTnr(30, "r:@a+", EParseErrorCode::kRegexError);
   TestTnr(31, "r:+@a", EParseErrorCode::kRegexError);
   TestTnr(32, "r:a++b", EParseErrorCode::kRegexError);
@@ -415,6 +571,9 @@ void TestTokenizer() {
   TestTni(53, "B(1,,3)", EParseErrorCode::kRegexError);
   TestTni(54, "B(@@da)", EParseErrorCode::kRegexError);
   TestTni(55, "B(ju@)", EParseErrorCode::kRegexError);
+  TestTni(56, "B()", EParseErrorCode::kRegexError);
+  TestTni(57, "B(1) C", EParseErrorCode::kRegexError);
+  TestTni(58, "MOVS(r0, 0x10000000000000010)", EParseErrorCode::kOutOfRange);
   std::cout << std::endl;
 
   PutTestHeader("TryTokenizeNamedTag", std::cout);
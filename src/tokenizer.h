@@ -1,28 +1,34 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <tuple>
 
+#include "preprocess.h"
 #include "types.h"
 
 namespace a2 {
 
+// Names in the tokenized AST are interned symbols. NamedConstant::name and the result of
+// TokenizeConstRef are views into the input, the input must outlive them. Lines come from a
+// LineIndex, which has already counted their indent: the tokenizers start after it.
+
 struct NamedConstant {
-  std::string name;
-  unsigned int value = 0;
+  std::string_view name;
+  std::size_t value = 0;
   std::size_t indent = 0;
 };
 
-NamedConstant TokenizeNamedConstant(const std::string& s); 
+NamedConstant TokenizeNamedConstant(const SourceLine& line);
 
-NamedRef TokenizeNamedRef(const std::string& s);
+NamedRef TokenizeNamedRef(const SourceLine& line);
 
-Instruction TokenizeInstruction(const std::string& s);
+Instruction TokenizeInstruction(const SourceLine& line);
 
-std::tuple<bool, std::string> TryTokenizeNamedTag(const std::string& s);
+std::tuple<bool, Symbol> TryTokenizeNamedTag(const SourceLine& line);
 
-std::vector<std::string> TokenizeConstRef(const std::string& s);
+std::vector<std::string_view> TokenizeConstRef(std::string_view s);
 
 }
 
@@ -1,34 +1,32 @@
 #include "types.h"
 
 namespace a2 {
-  
-std::unordered_map<ERefedType, std::string> gRefedTypeToStr = {
-  { ERefedType::kNone, "kNone" },
-  { ERefedType::kConst, "kConst" },
-  { ERefedType::kAddr, "kAddr"},
-  { ERefedType::kNum, "kNum"}};
 
-std::unordered_map<ERefedOp, std::string> gRefedOpToStr {
-  { ERefedOp::kNone, "kNone" },
-  { ERefedOp::kAdd, "kAdd" },
-  { ERefedOp::kSubtract, "kSubtract" }};
-
-std::unordered_map<ERefedOp, std::string> gRefedOpToChar {
-  { ERefedOp::kNone, "" },
-  { ERefedOp::kAdd, "+" },
-  { ERefedOp::kSubtract, "-" }};
-
-Refed::Refed(const std::string& ref, ERefedOp op) {
+Refed::Refed(std::string_view ref, ERefedOp op) {
   if (ref[0] == '@') {
-    this->ref = ref.substr(1);
+    this->ref = Intern(ref.substr(1));
     this->type = ERefedType::kAddr;
   } else {
-    this->ref = ref;
+    this->ref = Intern(ref);
     this->type = ERefedType::kConst;
   }
   this->op = op;
 }
 
+int RegisterNumber(std::string_view name) {
+  if (name == "sp") { return 13; }
+  if (name == "lr") { return 14; }
+  if (name == "pc") { return 15; }
+
+  if (name.length() < 2 || name.length() > 3 || name[0] != 'r') { return -1; }
+  int n = 0;
+  for (auto c : name.substr(1)) {
+    if (c < '0' || c > '9') { return -1; }
+    n = n * 10 + (c - '0');
+  }
+  return (n > 15 || (name.length() == 3 && name[1] == '0')) ? -1 : n;
+}
+
 Refed::Refed(std::size_t num, ERefedOp op) {
   this->num = num;
   this->op = op;
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <memory>
 #include <vector>
 #include <unordered_map>
 
+#include "constants.h"
+#include "smallvector.h"
+#include "symbol.h"
+#include "util.h"
+
 constexpr std::size_t INDENT_UNIT = 2;
 
 namespace a2 {
@@ -13,7 +19,8 @@ enum class EBlockType {
   None,
   Constants,
   Table,
-  Code
+  Code,
+  Include
 };
 
 enum class ConstantsType {
@@ -22,63 +29,81 @@ enum class ConstantsType {
   HasBitsInfo
 };
 
-enum class ERefedType {
+enum class ERefedType : std::uint8_t {
   kNone,
   kConst,
   kAddr,
-  kNum
+  kNum,
+  kReg,       // core register in an instruction argument, num holds its number
+  kCount
 };
 
-enum class ERefedOp {
+enum class ERefedOp : std::uint8_t {
   kNone,
   kAdd,
-  kSubtract
+  kSubtract,
+  kCount
 };
 
-extern std::unordered_map<ERefedType, std::string> gRefedTypeToStr;
-extern std::unordered_map<ERefedOp, std::string> gRefedOpToStr;
-extern std::unordered_map<ERefedOp, std::string> gRefedOpToChar;
-
-struct BitsInfo {
-  std::string name;
-  std::size_t size = 0;
-};
-
-struct ConstantsData {
-  std::string name;
-  std::size_t value = 0;;
-  std::unordered_map<std::string, std::unique_ptr<ConstantsData>> children;
-  std::vector<BitsInfo> bits_info;
-};
+constexpr EnumTable<ERefedType, 5> gRefedTypeToStr = {{ "kNone", "kConst", "kAddr", "kNum", "kReg" }};
+constexpr EnumTable<ERefedOp, 3> gRefedOpToStr = {{ "kNone", "kAdd", "kSubtract" }};
+constexpr EnumTable<ERefedOp, 3> gRefedOpToChar = {{ "", "+", "-" }};
+static_assert(NamesAll(gRefedTypeToStr) && NamesAll(gRefedOpToStr) && NamesAll(gRefedOpToChar));
 
+// One term of a series: a symbol for kConst and kAddr, a number for kNum, both for kReg.
 struct Refed {
   ERefedType type = ERefedType::kNone;
   ERefedOp op = ERefedOp::kNone;
-  std::string ref;
-  std::size_t num = 0;
+  Symbol ref;
+  std::uint64_t num = 0;
 
   Refed() = default;
-  Refed(const std::string& ref, ERefedOp op = ERefedOp::kNone);
+  Refed(std::string_view ref, ERefedOp op = ERefedOp::kNone);
   Refed(std::size_t num, ERefedOp op = ERefedOp::kNone);
 };
 
+static_assert(sizeof(Refed) == 16, "four terms to a cache line");
+
+// Arithmetic series of a table entry or an instruction argument, and the arguments of an
+// instruction. Nearly all fit inline (a term or two, up to three arguments), so an instruction
+// and its operands are one contiguous record and tokenizing it allocates nothing.
+using ArithSeries = SmallVector<Refed, 2>;
+using InstructionArgs = SmallVector<ArithSeries, 3>;
+
+// number of a core register name (r0-r15, sp, lr, pc), -1 for any other name
+int RegisterNumber(std::string_view name);
+
 struct NamedRef {
-  std::string name;
-  std::vector<Refed> value;
+  Symbol name;
+  ArithSeries value;
   std::size_t indent = 0;
 };
 
 struct Instruction {
-  std::string tag;
-  std::string func;
-  std::vector<std::vector<Refed>> args;
+  Symbol tag;
+  Symbol func;
+  InstructionArgs args;
   std::size_t indent = 0;
 };
 
+struct CodeBlock {
+  Symbol name;
+  std::size_t begin = 0;    // index of its first instruction
+};
+
+// a file the program was parsed from, identified by the hash of its text (SourceBuffer::Hash)
+struct SourceFile {
+  std::string path;
+  std::uint64_t hash = 0;
+  std::size_t size = 0;
+};
+
 struct A2 {
-  std::unordered_map<std::string, std::unique_ptr<ConstantsData>> constants;
+  ConstantsTable constants;
   std::vector<NamedRef> table;
   std::vector<Instruction> instructions;
+  std::vector<CodeBlock> code_blocks;
+  std::vector<SourceFile> sources;    // the parsed file first, then included files in merge order
 };
 
 }
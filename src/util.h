@@ -5,6 +5,30 @@
 
 namespace a2 {
 
+// Enum-indexed name table, constant-initialized so that it costs nothing at startup.
+// Entries must be listed in enumerator order.
+template <typename E, std::size_t N>
+struct EnumTable {
+  const char* names[N];
+
+  constexpr const char* operator[](E e) const { return names[static_cast<std::size_t>(e)]; }
+};
+
+// true if table has a name for every enumerator before E::kCount and no more; each table
+// static_asserts it so that an enumerator added without a name fails to compile
+template <typename E, std::size_t N>
+constexpr bool NamesAll(const EnumTable<E, N>& table) {
+  if (N != static_cast<std::size_t>(E::kCount)) {
+    return false;
+  }
+  for (auto name : table.names) {
+    if (name == nullptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
 template <typename T>
 std::string ToHexStr(T n, bool add_prefix) {
   std::stringstream ss;